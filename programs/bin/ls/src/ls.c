@@ -0,0 +1,31 @@
+#include "stdio.h"
+#include "string.h"
+#include "taios.h"
+
+int
+main(int argc, char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : "0:/";
+
+    int dir = opendir(path);
+    if (!dir) {
+        printf("ls: cannot open %s\n", path);
+        return 1;
+    }
+
+    struct dirent entry;
+    while (readdir(dir, &entry) == 0) {
+        if (strcmp(entry.name, ".") == 0 || strcmp(entry.name, "..") == 0) {
+            continue;
+        }
+
+        if (entry.stat.flags & STAT_FLAG_DIRECTORY) {
+            printf("%s/\n", entry.name);
+        } else {
+            printf("%s %d\n", entry.name, entry.stat.size);
+        }
+    }
+
+    closedir(dir);
+    return 0;
+}
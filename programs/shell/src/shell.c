@@ -15,6 +15,11 @@ main(int argc, char* argv[])
 
         gets(command);
 
+        if (strcmp(command, "shutdown") == 0) {
+            // writes the cached disk data back before powering off
+            shutdown();
+        }
+
         char path[MAX_COMMAND_LENGTH] = "0:/";
         strcat(path, command);
 
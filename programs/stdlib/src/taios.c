@@ -70,3 +70,145 @@ exit(int status)
 {
     make_syscall(SYSCALL_EXIT, 1, status);
 }
+
+/// @brief Creates a shared memory segment, or opens the existing one with the same name. A segment created here is
+/// destroyed when this process exits, so a producer must outlive the attach of its consumers (see taios.h).
+int
+shm_create(const char* name, size_t size)
+{
+    if (!name || strlen(name) == 0 || strlen(name) >= MAX_SHM_NAME_LENGTH || size == 0) {
+        return -1;
+    }
+    return make_syscall(SYSCALL_SHM_CREATE, 2, (uint32_t)name, (uint32_t)size);
+}
+
+void*
+shm_attach(int id)
+{
+    return (void*)make_syscall(SYSCALL_SHM_ATTACH, 1, (uint32_t)id);
+}
+
+int
+shm_detach(void* ptr)
+{
+    return make_syscall(SYSCALL_SHM_DETACH, 1, (uint32_t)ptr);
+}
+
+/// @brief Destroys the segment. It can't be attached anymore, and its memory is freed once every process detaches it.
+/// Only the process that created the segment can destroy it. Segments are also destroyed when their creator exits.
+int
+shm_destroy(int id)
+{
+    return make_syscall(SYSCALL_SHM_DESTROY, 1, (uint32_t)id);
+}
+
+int
+sync()
+{
+    return make_syscall(SYSCALL_SYNC, 0);
+}
+
+int
+fsync(int fd)
+{
+    return make_syscall(SYSCALL_FSYNC, 1, (uint32_t)fd);
+}
+
+void
+shutdown()
+{
+    make_syscall(SYSCALL_SHUTDOWN, 0);
+}
+
+/// @brief Opens a directory to list its items with `readdir()`.
+/// @return The directory descriptor (> 0), or 0 on error
+int
+opendir(const char* path)
+{
+    if (!path || strlen(path) == 0 || strlen(path) >= MAX_PATH_LENGTH) {
+        return 0;
+    }
+    return make_syscall(SYSCALL_OPENDIR, 1, (uint32_t)path);
+}
+
+/// @brief Reads the next item of the directory into `entry`.
+/// @return 0, or a negative value after the last item or on error
+int
+readdir(int dir, struct dirent* entry)
+{
+    if (!entry) {
+        return -1;
+    }
+    return make_syscall(SYSCALL_READDIR, 2, (uint32_t)dir, (uint32_t)entry);
+}
+
+int
+closedir(int dir)
+{
+    return make_syscall(SYSCALL_CLOSEDIR, 1, (uint32_t)dir);
+}
+
+/// @brief Opens a file to read it. `mode` must be "r": files can't be written from programs yet.
+/// @return The file descriptor (> 0), or 0 on error
+int
+open(const char* path, const char* mode)
+{
+    if (!path || !mode || strlen(path) == 0 || strlen(path) >= MAX_PATH_LENGTH) {
+        return 0;
+    }
+    return make_syscall(SYSCALL_OPEN, 2, (uint32_t)path, (uint32_t)mode);
+}
+
+/// @brief Reads up to `size` bytes of the file into `buffer`. The buffer can be any size.
+/// @return The number of bytes read, which is less than `size` at the end of the file, or a negative value on error
+int
+read(int fd, void* buffer, size_t size)
+{
+    if (!buffer) {
+        return -1;
+    }
+    if (size == 0) {
+        return 0;
+    }
+    return make_syscall(SYSCALL_READ, 3, (uint32_t)fd, (uint32_t)buffer, (uint32_t)size);
+}
+
+/// @brief Reads the file from `offset` into each of the `count` buffers in turn, in one call. The position of the file
+/// doesn't move, so records at known offsets can be read without a seek per record.
+/// @return The number of bytes read, which is less than the total size of the buffers at the end of the file, or a
+/// negative value on error
+int
+preadv(int fd, const struct iovec* vectors, int count, unsigned int offset)
+{
+    if (!vectors || count < 0) {
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    return make_syscall(SYSCALL_PREADV, 4, (uint32_t)fd, (uint32_t)vectors, (uint32_t)count, (uint32_t)offset);
+}
+
+/// @brief Moves the position of the file. `whence` is SEEK_SET, SEEK_CUR or SEEK_END.
+/// @return 0, or a negative value on error
+int
+lseek(int fd, unsigned int offset, int whence)
+{
+    return make_syscall(SYSCALL_LSEEK, 3, (uint32_t)fd, (uint32_t)offset, (uint32_t)whence);
+}
+
+int
+fstat(int fd, struct stat* stat)
+{
+    if (!stat) {
+        return -1;
+    }
+    return make_syscall(SYSCALL_FSTAT, 2, (uint32_t)fd, (uint32_t)stat);
+}
+
+/// @brief Closes a file or a directory.
+int
+close(int fd)
+{
+    return make_syscall(SYSCALL_CLOSE, 1, (uint32_t)fd);
+}
@@ -2,8 +2,12 @@
 #define TAIOS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
-#define MAX_COMMAND_LENGTH 1024
+#define MAX_COMMAND_LENGTH   1024
+#define MAX_SHM_NAME_LENGTH  32
+#define MAX_PATH_LENGTH      108
+#define MAX_FILE_NAME_LENGTH 256
 
 struct command_args
 {
@@ -11,15 +15,82 @@ struct command_args
     struct command_args* next;
 };
 
-#define SYSCALL_EXEC    0
-#define SYSCALL_EXIT    1
-#define SYSCALL_GETCHAR 2
-#define SYSCALL_PUTCHAR 3
-#define SYSCALL_PUTS    4
-#define SYSCALL_MALLOC  5
-#define SYSCALL_FREE    6
+#define STAT_FLAG_HIDDEN    1
+#define STAT_FLAG_SYSTEM    2
+#define STAT_FLAG_READONLY  4
+#define STAT_FLAG_DIRECTORY 8
+#define STAT_FLAG_ARCHIVE   16
+
+// This is `struct file_stat` in the kernel
+struct stat
+{
+    unsigned int size;
+    unsigned int flags; // STAT_FLAG_*
+};
+
+// An item of a directory. This is `struct file_dirent` in the kernel.
+struct dirent
+{
+    char name[MAX_FILE_NAME_LENGTH];
+    struct stat stat;
+};
+
+// One of the buffers of `preadv()`. This is `struct file_io_vector` in the kernel.
+struct iovec
+{
+    void* buffer;
+    size_t size;
+};
+
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+#define SYSCALL_EXEC        0
+#define SYSCALL_EXIT        1
+#define SYSCALL_GETCHAR     2
+#define SYSCALL_PUTCHAR     3
+#define SYSCALL_PUTS        4
+#define SYSCALL_MALLOC      5
+#define SYSCALL_FREE        6
+#define SYSCALL_SHM_CREATE  7
+#define SYSCALL_SHM_ATTACH  8
+#define SYSCALL_SHM_DETACH  9
+#define SYSCALL_SYNC        10
+#define SYSCALL_FSYNC       11
+#define SYSCALL_SHUTDOWN    12
+#define SYSCALL_OPENDIR     13
+#define SYSCALL_READDIR     14
+#define SYSCALL_CLOSEDIR    15
+#define SYSCALL_OPEN        16
+#define SYSCALL_READ        17
+#define SYSCALL_LSEEK       18
+#define SYSCALL_FSTAT       19
+#define SYSCALL_CLOSE       20
+#define SYSCALL_SHM_DESTROY 21
+#define SYSCALL_PREADV      22
 
 int exec(const char* path);
 void exit(int status);
+// Shared memory segments belong to the process that creates them. The segment stays alive while its creator runs,
+// even when no process has it attached, and it's destroyed when the creator calls `shm_destroy()` or exits. A process
+// that attached it keeps its mapping until it detaches it, but the segment can't be attached anymore. So the creator
+// (i.e., a producer) must keep running until every other process (i.e., the consumers) has attached the segment.
+int shm_create(const char* name, size_t size);
+void* shm_attach(int id);
+int shm_detach(void* ptr);
+int shm_destroy(int id);
+int sync();
+int fsync(int fd);
+void shutdown();
+int opendir(const char* path);
+int readdir(int dir, struct dirent* entry);
+int closedir(int dir);
+int open(const char* path, const char* mode);
+int read(int fd, void* buffer, size_t size);
+int preadv(int fd, const struct iovec* vectors, int count, unsigned int offset);
+int lseek(int fd, unsigned int offset, int whence);
+int fstat(int fd, struct stat* stat);
+int close(int fd);
 
 #endif
@@ -28,14 +28,50 @@
 #define USER_PROGRAM_STACK_VIRTUAL_ADDRESS_END   USER_PROGRAM_STACK_VIRTUAL_ADDRESS_START - USER_PROGRAM_STACK_SIZE
 
 #define MAX_PROCESSES               10
+#define TASK_KERNEL_STACK_SIZE      HEAP_BLOCK_SIZE_BYTES * 8 // 32KB per task
 #define MAX_ALLOCATIONS_PER_PROCESS 1024
 #define MAX_COMMAND_LENGTH          1024
 #define MAX_COMMAND_ARGS            32
 
-#define DISK_SECTOR_SIZE_BYTES    512
-#define MAX_PATH_LENGTH           108
-#define MAX_FILE_SYSTEM_COUNT     16
-#define MAX_FILE_DESCRIPTOR_COUNT 512 // Max number of open files
+#define MAX_SHARED_MEMORY_COUNT       32 // Max number of shared memory segments in the system
+#define MAX_SHARED_MEMORY_PER_PROCESS 16 // Max number of segments a process can attach at once
+#define MAX_SHARED_MEMORY_NAME_LENGTH 32
+
+#define DISK_SECTOR_SIZE_BYTES           512
+#define MAX_PATH_LENGTH                  108
+#define MAX_FILE_NAME_LENGTH             256 // Names returned by `readdir()`, long enough for VFAT long names
+#define MAX_FILE_SYSTEM_COUNT            16
+#define MAX_FILE_DESCRIPTOR_COUNT        512 // Max number of open files in the system. A multiple of 32.
+#define MAX_FILE_DESCRIPTORS_PER_PROCESS 64  // Max number of open files per process. A multiple of 32.
+#define MAX_DISK_COUNT                   4
+
+// Copy this many sectors of the boot disk into a RAM disk (disk 1) at boot. 0 disables the boot RAM disk.
+#define DISK_BOOT_RAMDISK_SECTORS 0
+
+// Disk buffer cache. Recently read sectors are kept in memory and shared by all disk streams.
+#define DISK_BUFFER_CACHE_SECTORS          1024 // 512KB
+#define DISK_BUFFER_CACHE_HASH_BUCKETS     256  // must be a power of 2
+#define DISK_BUFFER_CACHE_MAX_FILL_SECTORS 16   // Larger reads and writes (i.e., file data) bypass the cache
+// Small writes stay in the cache until they are written back. This happens every few seconds, when too many sectors
+// are dirty, or on sync/fsync/shutdown.
+#define DISK_BUFFER_CACHE_MAX_DIRTY_SECTORS 256
+#define DISK_BUFFER_CACHE_WRITEBACK_TICKS   91 // ~5s at the PIT's default 18.2Hz
+
+// Disk I/O scheduler. Adjacent requests are merged into one command, up to what a single ATA command can transfer.
+#define DISK_SCHEDULER_MAX_MERGE_SECTORS  256
+#define DISK_SCHEDULER_MAX_MERGE_REQUESTS 16
+#define DISK_SCHEDULER_DEADLINE           16 // A request is served after at most this many other dispatches
+
+// Sequential disk stream reads prefetch the sectors that follow. The window starts small and doubles on every
+// sequential read.
+#define DISK_READAHEAD_MIN_SECTORS 8
+#define DISK_READAHEAD_MAX_SECTORS 128 // one FAT16 cluster
+
+// Directory entry cache. Path lookups that hit it don't touch the disk.
+#define DENTRY_CACHE_SIZE         256
+#define DENTRY_CACHE_HASH_BUCKETS 64 // must be a power of 2
+#define DENTRY_NAME_LENGTH        64 // Longer names are not cached
+#define DENTRY_DATA_SIZE          48 // Room for the file system's directory entry and where it is on the disk
 
 #define MAX_KEYBOARD_DRIVER_COUNT 16
 
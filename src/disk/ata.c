@@ -0,0 +1,380 @@
+#include "ata.h"
+#include "../config.h"
+#include "../io/io.h"
+#include "ide_dma.h"
+#include "queue.h"
+
+// Primary ATA bus I/O ports
+// https://wiki.osdev.org/ATA_PIO_Mode#Registers
+#define ATA_REG_DATA         0x1F0
+#define ATA_REG_ERROR        0x1F1
+#define ATA_REG_SECTOR_COUNT 0x1F2
+#define ATA_REG_LBA_LOW      0x1F3
+#define ATA_REG_LBA_MID      0x1F4
+#define ATA_REG_LBA_HIGH     0x1F5
+#define ATA_REG_DRIVE        0x1F6
+#define ATA_REG_STATUS       0x1F7
+#define ATA_REG_COMMAND      0x1F7
+#define ATA_REG_ALT_STATUS   0x3F6 // read
+#define ATA_REG_CONTROL      0x3F6 // write
+
+#define ATA_STATUS_ERR 0x01 // an error occurred
+#define ATA_STATUS_DRQ 0x08 // the drive has data to transfer, or is ready to accept data
+#define ATA_STATUS_DF  0x20 // drive fault
+#define ATA_STATUS_BSY 0x80 // the drive is preparing to send/receive data
+
+#define ATA_CONTROL_NIEN 0x02 // stop the drive from raising IRQ 14
+
+// https://wiki.osdev.org/ATA_Command_Matrix
+#define ATA_COMMAND_READ_SECTORS      0x20
+#define ATA_COMMAND_WRITE_SECTORS     0x30
+#define ATA_COMMAND_READ_MULTIPLE     0xC4
+#define ATA_COMMAND_WRITE_MULTIPLE    0xC5
+#define ATA_COMMAND_SET_MULTIPLE_MODE 0xC6
+#define ATA_COMMAND_READ_DMA          0xC8
+#define ATA_COMMAND_WRITE_DMA         0xCA
+#define ATA_COMMAND_FLUSH_CACHE       0xE7
+#define ATA_COMMAND_IDENTIFY          0xEC
+
+#define ATA_DRIVE_MASTER_LBA        0xE0
+#define ATA_IDENTIFY_TOTAL_SECTORS  60  // IDENTIFY words 60-61: total number of user addressable sectors (LBA28)
+#define ATA_IDENTIFY_MAX_MULTIPLE   47  // IDENTIFY word: max sectors per DRQ block for READ/WRITE MULTIPLE
+#define ATA_MAX_SECTORS_PER_COMMAND 256 // the sector count register is 8-bit, and 0 means 256
+#define ATA_WORDS_PER_SECTOR        (DISK_SECTOR_SIZE_BYTES / 2)
+
+// Reading the alternate status register takes ~100ns. Reading it 4 times gives the drive the 400ns it needs to put
+// the correct value in the status register after a command is sent.
+static void
+ata_delay_400ns()
+{
+    for (int i = 0; i < 4; i++) {
+        inb(ATA_REG_ALT_STATUS);
+    }
+}
+
+/// @brief Waits until the drive is ready to transfer the next DRQ block.
+/// @return ALL_OK if the data is ready, or EIO if the drive reports an error.
+static status_t
+ata_wait_for_data()
+{
+    unsigned char status = inb(ATA_REG_STATUS);
+    while ((status & ATA_STATUS_BSY) || !(status & (ATA_STATUS_DRQ | ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        status = inb(ATA_REG_STATUS);
+    }
+
+    if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+        return ERROR(EIO);
+    }
+    return ALL_OK;
+}
+
+static void
+ata_wait_while_busy()
+{
+    while (inb(ATA_REG_STATUS) & ATA_STATUS_BSY) {}
+}
+
+/// @brief Identifies the drive, and enables READ MULTIPLE with the largest DRQ block size the drive supports. With READ
+/// MULTIPLE, the drive raises DRQ once per block of sectors instead of once per sector, so we wait on the status port
+/// far less often.
+/// @param disk The disk to configure. `total_sectors` is set to the size of the drive, and `multiple_sector_count` to
+/// the block size, or 0 if not supported.
+static void
+ata_identify(struct disk* disk)
+{
+    unsigned short identify[ATA_WORDS_PER_SECTOR];
+
+    disk->total_sectors = 0;
+    disk->multiple_sector_count = 0;
+
+    outb(ATA_REG_DRIVE, ATA_DRIVE_MASTER_LBA);
+    outb(ATA_REG_SECTOR_COUNT, 0);
+    outb(ATA_REG_LBA_LOW, 0);
+    outb(ATA_REG_LBA_MID, 0);
+    outb(ATA_REG_LBA_HIGH, 0);
+    outb(ATA_REG_COMMAND, ATA_COMMAND_IDENTIFY);
+    ata_delay_400ns();
+
+    // status 0 means there is no drive on the bus
+    if (inb(ATA_REG_STATUS) == 0) {
+        return;
+    }
+
+    if (ata_wait_for_data() != ALL_OK) {
+        return;
+    }
+    insw(ATA_REG_DATA, identify, ATA_WORDS_PER_SECTOR);
+
+    disk->total_sectors =
+      identify[ATA_IDENTIFY_TOTAL_SECTORS] | ((unsigned int)identify[ATA_IDENTIFY_TOTAL_SECTORS + 1] << 16);
+
+    // bits 0-7: max number of sectors per DRQ block. 0 means READ/WRITE MULTIPLE are not supported.
+    unsigned int max_multiple = identify[ATA_IDENTIFY_MAX_MULTIPLE] & 0xFF;
+    if (max_multiple == 0) {
+        return;
+    }
+
+    outb(ATA_REG_DRIVE, ATA_DRIVE_MASTER_LBA);
+    outb(ATA_REG_SECTOR_COUNT, (unsigned char)max_multiple);
+    outb(ATA_REG_COMMAND, ATA_COMMAND_SET_MULTIPLE_MODE);
+    ata_delay_400ns();
+    ata_wait_while_busy();
+
+    if (inb(ATA_REG_STATUS) & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+        return;
+    }
+    disk->multiple_sector_count = max_multiple;
+}
+
+static void
+ata_select_sectors(unsigned int lba, unsigned int total)
+{
+    // This is the same deal as in `boot.asm`.
+    // Refer to `ata_lba_read` in https://wiki.osdev.org/ATA_read/write_sectors for more.
+    outb(ATA_REG_DRIVE, ((lba >> 24) & 0x0F) | ATA_DRIVE_MASTER_LBA); // Send the highest 4 bits of the LBA
+    outb(ATA_REG_SECTOR_COUNT, (unsigned char)total);                 // Send the total sectors to read (0 = 256)
+    outb(ATA_REG_LBA_LOW, (unsigned char)(lba & 0xff));               // Port to send bits 0-7 of LBA
+    outb(ATA_REG_LBA_MID, (unsigned char)(lba >> 8));                 // Port to send bits 8-15 of LBA
+    outb(ATA_REG_LBA_HIGH, (unsigned char)(lba >> 16));               // Port to send bits 16-23 of LBA
+}
+
+void
+ata_initialize(struct disk* disk)
+{
+    // Keep the drive quiet while we identify it. We poll the status port here, and the kernel isn't ready to take the
+    // interrupts yet.
+    outb(ATA_REG_CONTROL, ATA_CONTROL_NIEN);
+    ata_identify(disk);
+
+    // From now on, the drive raises IRQ 14 whenever a DRQ block is ready (PIO) or a transfer has finished (DMA), and
+    // the disk request queue completes the requests from the interrupt handler.
+    inb(ATA_REG_STATUS);
+    outb(ATA_REG_CONTROL, 0);
+}
+
+// Builds the PRD table for the command. Every request of a merged chain gets its own PRD entries, so the controller
+// reads straight into each request's buffer.
+static bool
+ata_prepare_dma(struct disk_request* request, unsigned int count)
+{
+    ide_dma_reset();
+
+    if (!request->merge_next) {
+        void* ptr = (unsigned char*)request->buf + request->transferred * DISK_SECTOR_SIZE_BYTES;
+        if (ide_dma_add_buffer(ptr, count * DISK_SECTOR_SIZE_BYTES) != ALL_OK) {
+            return false;
+        }
+    } else {
+        for (struct disk_request* merged = request; merged; merged = merged->merge_next) {
+            if (ide_dma_add_buffer(merged->buf, merged->total * DISK_SECTOR_SIZE_BYTES) != ALL_OK) {
+                return false;
+            }
+        }
+    }
+
+    ide_dma_arm(request->type == DISK_REQUEST_TYPE_WRITE);
+    return true;
+}
+
+// Number of sectors the drive transfers per DRQ block with PIO. The last block of a command may be shorter.
+static unsigned int
+ata_pio_block_sectors(struct disk_request* request)
+{
+    unsigned int sectors_per_block = request->disk->multiple_sector_count ? request->disk->multiple_sector_count : 1;
+    unsigned int remaining = request->command_total - request->command_transferred;
+    return remaining > sectors_per_block ? sectors_per_block : remaining;
+}
+
+// Copies `sectors` sectors between the data port and the buffers of the chain, continuing where the last block ended
+static void
+ata_transfer_pio_block(struct disk_request* request, unsigned int sectors)
+{
+    request->command_transferred += sectors;
+
+    struct disk_request* target = request;
+    while (sectors > 0 && target) {
+        if (target->transferred == target->total) {
+            target = target->merge_next;
+            continue;
+        }
+
+        unsigned int remaining = target->total - target->transferred;
+        unsigned int count = sectors > remaining ? remaining : sectors;
+        unsigned char* ptr = (unsigned char*)target->buf + target->transferred * DISK_SECTOR_SIZE_BYTES;
+
+        if (request->type == DISK_REQUEST_TYPE_WRITE) {
+            outsw(ATA_REG_DATA, ptr, count * ATA_WORDS_PER_SECTOR);
+        } else {
+            insw(ATA_REG_DATA, ptr, count * ATA_WORDS_PER_SECTOR);
+        }
+        target->transferred += count;
+        sectors -= count;
+    }
+}
+
+static unsigned char
+ata_select_command(struct disk_request* request)
+{
+    bool write = request->type == DISK_REQUEST_TYPE_WRITE;
+    if (request->dma) {
+        return write ? ATA_COMMAND_WRITE_DMA : ATA_COMMAND_READ_DMA;
+    }
+    if (request->disk->multiple_sector_count) {
+        return write ? ATA_COMMAND_WRITE_MULTIPLE : ATA_COMMAND_READ_MULTIPLE;
+    }
+    return write ? ATA_COMMAND_WRITE_SECTORS : ATA_COMMAND_READ_SECTORS;
+}
+
+/// @brief Issues the ATA command for the next chunk of `request`. A single command can transfer at most
+/// `ATA_MAX_SECTORS_PER_COMMAND` sectors, so larger requests are issued in several chunks. If the scheduler merged
+/// adjacent requests into `request` (see `merge_next`), the command transfers all of them at once. The data is
+/// transferred by the bus master DMA if the IDE controller supports it, otherwise with PIO (READ/WRITE MULTIPLE or
+/// READ/WRITE SECTORS).
+/// @param request The request to start. `transferred` sectors of it have already been transferred.
+/// @return ALL_OK if the command has been sent to the drive. The drive raises IRQ 14 when it has data for us, when it
+/// is ready for the next block of a write, and when the command is done.
+status_t
+ata_start_request(struct disk_request* request)
+{
+    if (request->type == DISK_REQUEST_TYPE_FLUSH) {
+        request->dma = false;
+        request->command_total = 0;
+        request->command_transferred = 0;
+        outb(ATA_REG_DRIVE, ATA_DRIVE_MASTER_LBA);
+        outb(ATA_REG_COMMAND, ATA_COMMAND_FLUSH_CACHE);
+        return ALL_OK;
+    }
+
+    unsigned int lba = request->lba + request->transferred;
+    unsigned int count = 0;
+    if (request->merge_next) {
+        // the scheduler keeps merged chains within the limit of a single command
+        for (struct disk_request* merged = request; merged; merged = merged->merge_next) {
+            count += merged->total;
+        }
+    } else {
+        unsigned int remaining = request->total - request->transferred;
+        count = remaining > ATA_MAX_SECTORS_PER_COMMAND ? ATA_MAX_SECTORS_PER_COMMAND : remaining;
+    }
+
+    request->command_total = count;
+    request->command_transferred = 0;
+    request->dma = ata_prepare_dma(request, count);
+
+    ata_select_sectors(lba, count);
+    outb(ATA_REG_COMMAND, ata_select_command(request));
+    if (request->dma) {
+        ide_dma_start();
+        return ALL_OK;
+    }
+
+    if (request->type == DISK_REQUEST_TYPE_WRITE) {
+        // The drive doesn't raise an interrupt for the first block of a PIO write. It raises one after every block it
+        // has taken, so we send the first one right away if the drive is ready for it. Otherwise `ata_poll_request()`
+        // sends it later. We don't wait for the drive here: this also runs in interrupt handlers (i.e., the clock tick
+        // starting the write-back).
+        ata_delay_400ns();
+        if (ata_poll_request(request)) {
+            return request->result;
+        }
+    }
+
+    return ALL_OK;
+}
+
+/// @brief Sends the first block of a PIO write once the drive is ready for it (see `ata_start_request()`). It only
+/// looks at the alternate status register, so it never waits and doesn't clear a pending interrupt of the drive.
+/// @param request The in-flight request
+/// @return true if the command has failed (see `request->result`)
+bool
+ata_poll_request(struct disk_request* request)
+{
+    if (request->dma || request->type != DISK_REQUEST_TYPE_WRITE || request->command_transferred > 0) {
+        return false;
+    }
+
+    unsigned char status = inb(ATA_REG_ALT_STATUS);
+    if (status & ATA_STATUS_BSY) {
+        return false;
+    }
+    if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+        request->result = ERROR(EIO);
+        return true;
+    }
+    if (status & ATA_STATUS_DRQ) {
+        ata_transfer_pio_block(request, ata_pio_block_sectors(request));
+    }
+    return false;
+}
+
+/// @brief Handles IRQ 14 for the in-flight `request`. For PIO, this transfers the DRQ block that is ready with
+/// `rep insw` (reads) or `rep outsw` (writes). For DMA, the whole transfer has already been done by the bus master.
+/// @param request The request the drive is working on (the first of the chain if requests were merged)
+/// @return true if the command for the current chunk has finished (successfully or not, see `request->result`).
+bool
+ata_handle_interrupt(struct disk_request* request)
+{
+    if (request->dma) {
+        if (!ide_dma_is_complete()) {
+            // not ours
+            return false;
+        }
+        request->result = ide_dma_finish();
+
+        // Reading the status register also clears the drive's pending interrupt.
+        if (inb(ATA_REG_STATUS) & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+            request->result = ERROR(EIO);
+        }
+        if (request->result != ALL_OK) {
+            return true;
+        }
+
+        if (request->merge_next) {
+            for (struct disk_request* merged = request; merged; merged = merged->merge_next) {
+                merged->transferred = merged->total;
+            }
+        } else {
+            request->transferred += request->command_total;
+        }
+        return true;
+    }
+
+    unsigned char status = inb(ATA_REG_STATUS);
+    if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+        request->result = ERROR(EIO);
+        return true;
+    }
+    if (status & ATA_STATUS_BSY) {
+        return false;
+    }
+
+    if (request->type == DISK_REQUEST_TYPE_FLUSH) {
+        return true;
+    }
+
+    if (request->type == DISK_REQUEST_TYPE_WRITE) {
+        // The drive raises an interrupt after each block it has taken. The one after the last block ends the command.
+        if (request->command_transferred == request->command_total) {
+            return true;
+        }
+        if (status & ATA_STATUS_DRQ) {
+            ata_transfer_pio_block(request, ata_pio_block_sectors(request));
+        }
+        return false;
+    }
+
+    if (!(status & ATA_STATUS_DRQ)) {
+        return false;
+    }
+
+    ata_transfer_pio_block(request, ata_pio_block_sectors(request));
+    return request->command_transferred == request->command_total;
+}
+
+/// @brief Acknowledges an IRQ 14 that doesn't belong to any request.
+void
+ata_acknowledge_interrupt()
+{
+    inb(ATA_REG_STATUS);
+    ide_dma_acknowledge_interrupt();
+}
@@ -0,0 +1,17 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "../status.h"
+#include "disk.h"
+#include <stdbool.h>
+
+// forward declaration
+struct disk_request;
+
+void ata_initialize(struct disk* disk);
+status_t ata_start_request(struct disk_request* request);
+bool ata_poll_request(struct disk_request* request);
+bool ata_handle_interrupt(struct disk_request* request);
+void ata_acknowledge_interrupt();
+
+#endif
@@ -0,0 +1,515 @@
+#include "buffer_cache.h"
+#include "../config.h"
+#include "../memory/heap/kheap.h"
+#include "../memory/memory.h"
+#include "../system/sys.h"
+#include "queue.h"
+#include <stdbool.h>
+
+enum BUFFER_CACHE_ENTRY_STATE
+{
+    BUFFER_CACHE_ENTRY_STATE_FREE = 0,
+    // A readahead request is filling the entry
+    BUFFER_CACHE_ENTRY_STATE_PENDING,
+    BUFFER_CACHE_ENTRY_STATE_VALID,
+    // A write-back request is writing the entry to the disk. The data is valid, but it must not change until then.
+    BUFFER_CACHE_ENTRY_STATE_WRITING,
+};
+
+// A cached copy of one sector
+struct buffer_cache_entry
+{
+    struct disk* disk;
+    unsigned int lba;
+    enum BUFFER_CACHE_ENTRY_STATE state;
+    // The data is newer than the sector on the disk
+    bool dirty;
+    char* data;
+
+    // Used by the readahead request of a pending entry, and by the write-back request of a writing one. Adjacent
+    // requests are merged by the disk scheduler, so many sectors are still transferred with a few commands.
+    struct disk_request request;
+
+    // entries in the same hash bucket
+    struct buffer_cache_entry* hash_next;
+
+    // LRU list. The head is the most recently used entry, and the tail is the next one to be evicted.
+    struct buffer_cache_entry* lru_prev;
+    struct buffer_cache_entry* lru_next;
+};
+
+static struct buffer_cache_entry entries[DISK_BUFFER_CACHE_SECTORS];
+static struct buffer_cache_entry* hash_table[DISK_BUFFER_CACHE_HASH_BUCKETS];
+static struct buffer_cache_entry* lru_head = 0;
+static struct buffer_cache_entry* lru_tail = 0;
+
+// One allocation for all sector buffers. Every kernel heap allocation takes at least a 4KB block, so allocating the
+// sectors one by one would waste 7/8 of the memory.
+static char* cache_data = 0;
+
+static struct buffer_cache_stats stats;
+
+static unsigned int dirty_count = 0;
+static unsigned int ticks_since_writeback = 0;
+
+static unsigned int
+hash(struct disk* disk, unsigned int lba)
+{
+    return (disk->id * 31 + lba) & (DISK_BUFFER_CACHE_HASH_BUCKETS - 1);
+}
+
+static void
+lru_remove(struct buffer_cache_entry* entry)
+{
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        lru_head = entry->lru_next;
+    }
+
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = 0;
+    entry->lru_next = 0;
+}
+
+static void
+lru_push_front(struct buffer_cache_entry* entry)
+{
+    entry->lru_prev = 0;
+    entry->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = entry;
+    } else {
+        lru_tail = entry;
+    }
+    lru_head = entry;
+}
+
+static void
+hash_remove(struct buffer_cache_entry* entry)
+{
+    struct buffer_cache_entry** slot = &hash_table[hash(entry->disk, entry->lba)];
+    while (*slot && *slot != entry) {
+        slot = &(*slot)->hash_next;
+    }
+    if (*slot) {
+        *slot = entry->hash_next;
+    }
+    entry->hash_next = 0;
+}
+
+static struct buffer_cache_entry*
+lookup(struct disk* disk, unsigned int lba)
+{
+    for (struct buffer_cache_entry* entry = hash_table[hash(disk, lba)]; entry; entry = entry->hash_next) {
+        if (entry->disk == disk && entry->lba == lba) {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+// Unlinks the entry from the hash table and puts it at the end of the LRU list, so that it's reused first
+static void
+release(struct buffer_cache_entry* entry)
+{
+    hash_remove(entry);
+    if (entry->dirty) {
+        entry->dirty = false;
+        dirty_count--;
+    }
+    entry->state = BUFFER_CACHE_ENTRY_STATE_FREE;
+    lru_remove(entry);
+    entry->lru_prev = lru_tail;
+    if (lru_tail) {
+        lru_tail->lru_next = entry;
+    } else {
+        lru_head = entry;
+    }
+    lru_tail = entry;
+}
+
+static void
+mark_dirty(struct buffer_cache_entry* entry)
+{
+    if (!entry->dirty) {
+        entry->dirty = true;
+        dirty_count++;
+    }
+}
+
+// Turns an entry whose request has completed into a valid one. Failed readaheads are dropped, and the entries of
+// failed write-backs stay dirty so that the next write-back tries again.
+static void
+settle(struct buffer_cache_entry* entry)
+{
+    if (entry->request.state != DISK_REQUEST_STATE_COMPLETE) {
+        return;
+    }
+
+    if (entry->state == BUFFER_CACHE_ENTRY_STATE_PENDING) {
+        if (entry->request.result == ALL_OK) {
+            entry->state = BUFFER_CACHE_ENTRY_STATE_VALID;
+        } else {
+            release(entry);
+        }
+    } else if (entry->state == BUFFER_CACHE_ENTRY_STATE_WRITING) {
+        entry->state = BUFFER_CACHE_ENTRY_STATE_VALID;
+        if (entry->request.result != ALL_OK) {
+            mark_dirty(entry);
+        }
+    }
+}
+
+// The disk is still transferring the buffer of the entry, so it can't be changed or reused
+static bool
+is_busy(struct buffer_cache_entry* entry)
+{
+    settle(entry);
+    return entry->state == BUFFER_CACHE_ENTRY_STATE_PENDING || entry->state == BUFFER_CACHE_ENTRY_STATE_WRITING;
+}
+
+// Waits for the request of a busy entry
+static void
+wait_until_idle(struct buffer_cache_entry* entry)
+{
+    if (is_busy(entry)) {
+        disk_queue_wait(&entry->request);
+        settle(entry);
+    }
+}
+
+// Marks the entry as the most recently used one
+static void
+touch(struct buffer_cache_entry* entry)
+{
+    if (entry != lru_head) {
+        lru_remove(entry);
+        lru_push_front(entry);
+    }
+}
+
+// Takes the least recently used entry that is neither busy nor dirty, and assigns it to the sector
+static struct buffer_cache_entry*
+allocate(struct disk* disk, unsigned int lba, enum BUFFER_CACHE_ENTRY_STATE state)
+{
+    struct buffer_cache_entry* entry = lru_tail;
+    while (entry && (is_busy(entry) || entry->dirty)) {
+        entry = entry->lru_prev;
+    }
+    if (!entry) {
+        return 0;
+    }
+
+    if (entry->state != BUFFER_CACHE_ENTRY_STATE_FREE) {
+        hash_remove(entry);
+        stats.evictions++;
+    }
+
+    entry->disk = disk;
+    entry->lba = lba;
+    entry->state = state;
+
+    unsigned int bucket = hash(disk, lba);
+    entry->hash_next = hash_table[bucket];
+    hash_table[bucket] = entry;
+
+    touch(entry);
+    return entry;
+}
+
+static void
+insert(struct disk* disk, unsigned int lba, const void* data)
+{
+    struct buffer_cache_entry* entry = lookup(disk, lba);
+    if (entry) {
+        touch(entry);
+    } else {
+        entry = allocate(disk, lba, BUFFER_CACHE_ENTRY_STATE_VALID);
+        if (!entry) {
+            // every entry is busy or dirty
+            return;
+        }
+    }
+
+    memcpy(entry->data, data, DISK_SECTOR_SIZE_BYTES);
+}
+
+void
+initialize_buffer_cache()
+{
+    memset(entries, 0, sizeof(entries));
+    memset(hash_table, 0, sizeof(hash_table));
+    memset(&stats, 0, sizeof(stats));
+    dirty_count = 0;
+    ticks_since_writeback = 0;
+    lru_head = 0;
+    lru_tail = 0;
+
+    cache_data = kzalloc(DISK_BUFFER_CACHE_SECTORS * DISK_SECTOR_SIZE_BYTES);
+    if (!cache_data) {
+        panic("Failed to allocate the disk buffer cache\n");
+    }
+
+    for (int i = 0; i < DISK_BUFFER_CACHE_SECTORS; i++) {
+        entries[i].data = cache_data + i * DISK_SECTOR_SIZE_BYTES;
+        lru_push_front(&entries[i]);
+    }
+}
+
+/// @brief Reads `total` sectors from `lba` into `buf`. Sectors found in the cache are copied from memory. The rest is
+/// read from the disk in as few requests as possible (one per run of consecutive missing sectors), and small runs are
+/// added to the cache.
+/// @param disk The disk to read from
+/// @param lba LBA (Logical Block Address) to read from
+/// @param total Total sectors to read
+/// @param buf A buffer to store the data
+/// @return Status code
+status_t
+buffer_cache_read(struct disk* disk, unsigned int lba, unsigned int total, void* buf)
+{
+    status_t result = ALL_OK;
+    char* out = (char*)buf;
+
+    unsigned int i = 0;
+    while (i < total) {
+        struct buffer_cache_entry* entry = lookup(disk, lba + i);
+        if (entry) {
+            settle(entry);
+        }
+        if (entry && entry->state == BUFFER_CACHE_ENTRY_STATE_PENDING) {
+            // The sector is on its way. Waiting for it is cheaper than reading it again.
+            wait_until_idle(entry);
+            stats.readahead_waits++;
+        }
+        if (entry && entry->state == BUFFER_CACHE_ENTRY_STATE_FREE) {
+            // the readahead failed, so the sector was dropped; read it on the normal path
+            continue;
+        }
+        if (entry) {
+            memcpy(out + i * DISK_SECTOR_SIZE_BYTES, entry->data, DISK_SECTOR_SIZE_BYTES);
+            touch(entry);
+            stats.hits++;
+            i++;
+            continue;
+        }
+
+        unsigned int run = 1;
+        while (i + run < total && !lookup(disk, lba + i + run)) {
+            run++;
+        }
+
+        result = disk_queue_read(disk, lba + i, run, out + i * DISK_SECTOR_SIZE_BYTES);
+        if (result != ALL_OK) {
+            break;
+        }
+        stats.misses += run;
+
+        // Large reads are file data that is usually read once. Caching them would only push out the metadata.
+        if (run <= DISK_BUFFER_CACHE_MAX_FILL_SECTORS) {
+            for (unsigned int j = 0; j < run; j++) {
+                insert(disk, lba + i + j, out + (i + j) * DISK_SECTOR_SIZE_BYTES);
+            }
+        }
+
+        i += run;
+    }
+
+    return result;
+}
+
+// Starts writing the dirty entries of `disk` (of every disk if it's 0) back, and returns without waiting. The disk
+// scheduler sorts the requests and merges the adjacent ones, so runs of dirty sectors are written with one command.
+static void
+start_writeback(struct disk* disk)
+{
+    for (int i = 0; i < DISK_BUFFER_CACHE_SECTORS && dirty_count > 0; i++) {
+        struct buffer_cache_entry* entry = &entries[i];
+        if (!entry->dirty || (disk && entry->disk != disk) || is_busy(entry)) {
+            continue;
+        }
+
+        entry->dirty = false;
+        dirty_count--;
+        entry->state = BUFFER_CACHE_ENTRY_STATE_WRITING;
+
+        memset(&entry->request, 0, sizeof(entry->request));
+        entry->request.type = DISK_REQUEST_TYPE_WRITE;
+        entry->request.disk = entry->disk;
+        entry->request.lba = entry->lba;
+        entry->request.total = 1;
+        entry->request.buf = entry->data;
+        disk_queue_submit(&entry->request);
+        stats.writebacks++;
+    }
+}
+
+// Writes the dirty entries of `disk` (of every disk if it's 0) back, and waits for them
+static status_t
+writeback(struct disk* disk)
+{
+    status_t result = ALL_OK;
+
+    start_writeback(disk);
+    for (int i = 0; i < DISK_BUFFER_CACHE_SECTORS; i++) {
+        struct buffer_cache_entry* entry = &entries[i];
+        if (entry->state != BUFFER_CACHE_ENTRY_STATE_WRITING || (disk && entry->disk != disk)) {
+            continue;
+        }
+
+        wait_until_idle(entry);
+        if (entry->dirty) {
+            result = ERROR(EIO);
+        }
+    }
+
+    return result;
+}
+
+/// @brief Writes `total` sectors from `buf` to `lba`. Small writes only update the cache, and the sectors are written
+/// back later (see `buffer_cache_flush()` and `buffer_cache_tick()`). Large writes are file data that is usually
+/// written once, so they go straight to the disk like large reads do.
+/// @param disk The disk to write to
+/// @param lba LBA (Logical Block Address) to write to
+/// @param total Total sectors to write
+/// @param buf The data to write
+/// @return Status code
+status_t
+buffer_cache_write(struct disk* disk, unsigned int lba, unsigned int total, const void* buf)
+{
+    status_t result = ALL_OK;
+    const char* in = (const char*)buf;
+
+    // A readahead that is still on its way would overwrite the new data with the old one when it completes, and a
+    // write-back is still sending the old data to the disk.
+    for (unsigned int i = 0; i < total; i++) {
+        struct buffer_cache_entry* entry = lookup(disk, lba + i);
+        if (entry) {
+            wait_until_idle(entry);
+        }
+    }
+
+    if (total > DISK_BUFFER_CACHE_MAX_FILL_SECTORS) {
+        result = disk_queue_write(disk, lba, total, buf);
+        for (unsigned int i = 0; i < total; i++) {
+            struct buffer_cache_entry* entry = lookup(disk, lba + i);
+            if (!entry) {
+                continue;
+            }
+            if (result != ALL_OK) {
+                // We don't know which sectors made it to the disk, so the cached copies can't be trusted anymore
+                release(entry);
+                continue;
+            }
+            memcpy(entry->data, in + i * DISK_SECTOR_SIZE_BYTES, DISK_SECTOR_SIZE_BYTES);
+            if (entry->dirty) {
+                entry->dirty = false;
+                dirty_count--;
+            }
+        }
+        return result;
+    }
+
+    // Don't let the dirty entries take over the cache
+    if (dirty_count + total > DISK_BUFFER_CACHE_MAX_DIRTY_SECTORS) {
+        result = writeback(0);
+        if (result != ALL_OK) {
+            return result;
+        }
+    }
+
+    for (unsigned int i = 0; i < total; i++) {
+        const char* data = in + i * DISK_SECTOR_SIZE_BYTES;
+        struct buffer_cache_entry* entry = lookup(disk, lba + i);
+        if (entry) {
+            touch(entry);
+        } else {
+            entry = allocate(disk, lba + i, BUFFER_CACHE_ENTRY_STATE_VALID);
+        }
+
+        if (!entry) {
+            // every entry is busy or dirty, so this sector can't wait in the cache
+            result = disk_queue_write(disk, lba + i, 1, data);
+            if (result != ALL_OK) {
+                return result;
+            }
+            continue;
+        }
+
+        memcpy(entry->data, data, DISK_SECTOR_SIZE_BYTES);
+        mark_dirty(entry);
+    }
+
+    return result;
+}
+
+/// @brief Writes the dirty sectors of `disk` back, waits for them, and makes the drive write its own cache to the
+/// media. When this returns successfully, everything written to the disk so far survives a power loss.
+/// @param disk The disk to flush
+/// @return Status code
+status_t
+buffer_cache_flush(struct disk* disk)
+{
+    status_t result = writeback(disk);
+    if (result != ALL_OK) {
+        return result;
+    }
+    return disk_queue_flush(disk);
+}
+
+/// @brief Called on every clock tick. Every `DISK_BUFFER_CACHE_WRITEBACK_TICKS` ticks, starts writing the dirty sectors
+/// back in the background, so that writes reach the disk in batches without anybody waiting for them.
+void
+buffer_cache_tick()
+{
+    ticks_since_writeback++;
+    if (ticks_since_writeback < DISK_BUFFER_CACHE_WRITEBACK_TICKS) {
+        return;
+    }
+
+    ticks_since_writeback = 0;
+    if (dirty_count > 0) {
+        start_writeback(0);
+    }
+}
+
+/// @brief Starts reading `total` sectors from `lba` into the cache, and returns without waiting for them. Sectors that
+/// are already cached are skipped. A later `buffer_cache_read()` of a sector that is still on its way waits for it
+/// instead of reading it again.
+/// @param disk The disk to read from
+/// @param lba LBA (Logical Block Address) of the first sector to prefetch
+/// @param total Total sectors to prefetch
+void
+buffer_cache_prefetch(struct disk* disk, unsigned int lba, unsigned int total)
+{
+    for (unsigned int i = 0; i < total; i++) {
+        if (lookup(disk, lba + i)) {
+            continue;
+        }
+
+        struct buffer_cache_entry* entry = allocate(disk, lba + i, BUFFER_CACHE_ENTRY_STATE_PENDING);
+        if (!entry) {
+            // every entry is being filled already
+            break;
+        }
+
+        memset(&entry->request, 0, sizeof(entry->request));
+        entry->request.disk = disk;
+        entry->request.lba = lba + i;
+        entry->request.total = 1;
+        entry->request.buf = entry->data;
+        disk_queue_submit(&entry->request);
+        stats.readaheads++;
+    }
+}
+
+void
+buffer_cache_get_stats(struct buffer_cache_stats* out_stats)
+{
+    memcpy(out_stats, &stats, sizeof(stats));
+}
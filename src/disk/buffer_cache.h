@@ -0,0 +1,26 @@
+#ifndef BUFFER_CACHE_H
+#define BUFFER_CACHE_H
+
+#include "../status.h"
+#include "disk.h"
+#include <stdint.h>
+
+struct buffer_cache_stats
+{
+    uint32_t hits;            // sectors served from memory
+    uint32_t misses;          // sectors read from the disk
+    uint32_t evictions;       // sectors dropped to make room for others
+    uint32_t readaheads;      // sectors prefetched before they were asked for
+    uint32_t readahead_waits; // prefetched sectors that were asked for while they were still on their way
+    uint32_t writebacks;      // dirty sectors written back to the disk
+};
+
+void initialize_buffer_cache();
+status_t buffer_cache_read(struct disk* disk, unsigned int lba, unsigned int total, void* buf);
+status_t buffer_cache_write(struct disk* disk, unsigned int lba, unsigned int total, const void* buf);
+status_t buffer_cache_flush(struct disk* disk);
+void buffer_cache_tick();
+void buffer_cache_prefetch(struct disk* disk, unsigned int lba, unsigned int total);
+void buffer_cache_get_stats(struct buffer_cache_stats* stats);
+
+#endif
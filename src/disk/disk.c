@@ -1,78 +1,147 @@
 #include "disk.h"
 #include "../config.h"
-#include "../io/io.h"
 #include "../memory/memory.h"
+#include "ata.h"
+#include "buffer_cache.h"
+#include "ide_dma.h"
+#include "ramdisk.h"
+#include <stdbool.h>
 
-struct disk current_disk;
+// The disk number is the index in this array. It's also the drive number in paths (i.e., 0:/, 1:/).
+static struct disk disks[MAX_DISK_COUNT];
+static unsigned int disk_count = 0;
 
-/// @brief Read `total` number of sectors (blocks) from the `lba` and store the read data to `buf`.
-/// @param lba LBA (Logical Block Address) to read from
-/// @param total Total blocks to read
-/// @param buf A buffer to store the data
-/// @return Status code
-status_t
-disk_read_sector(unsigned int lba, unsigned int total, void* buf)
-{
-    // This is the same deal as in `boot.asm`.
-    // Refer to `ata_lba_read` in https://wiki.osdev.org/ATA_read/write_sectors for more.
-    // You can also find ATA commands here: https://wiki.osdev.org/ATA_Command_Matrix
-    //
-    // For example, `0x20` as you see in the line `outb(0x1F7, 0x20)` is `READ SECTORS` command.
-
-    outb(0x1F6, (lba >> 24) | 0xE0);          // Send the highest 8 bits of the LBA to the disk controller
-    outb(0x1F2, total);                       // Send the total sectors to read
-    outb(0x1F3, (unsigned char)(lba & 0xff)); // Port to send bits 0-7 of LBA
-    outb(0x1F4, (unsigned char)(lba >> 8));   // Port to send bits 8-15 of LBA
-    outb(0x1F5, (unsigned char)(lba >> 16));  // Port to send bits 16-23 of LBA
-    outb(0x1F7, 0x20);                        // Send "Read with retry" command to the command port
-
-    // Cast the buffer pointer to `short`. The disk controller returns 1 word (2 bytes) at a time.
-    unsigned short* ptr = (unsigned short*)buf;
-
-    for (int b = 0; b < total; b++) {
-        // Wait for the buffer to be ready
-        char c = inb(0x1F7);
-        while (!(c & 0x08)) {
-            c = inb(0x1F7);
-        }
+// ATA drives go through the buffer cache, which sends the misses (and all writes) to the drive through the disk queue
+static struct disk_driver real_disk_driver = {
+    .name = "ATA",
+    .read = buffer_cache_read,
+    .write = buffer_cache_write,
+    .flush = buffer_cache_flush,
+};
 
-        // Ready to read. Copy 1 word from the hard disk to memory
-        for (int i = 0; i < 256; i++) // 256 = 512 bytes per sector / 2 bytes read at a time
-        {
-            *ptr = inw(0x1F0); // Read from the data port
-            ptr++;
-        }
+/// @brief Adds a disk to the registry. The caller resolves the file system once the disk is ready to be read.
+/// @param type DISK_TYPE_REAL or DISK_TYPE_RAM
+/// @param driver Block device operations of the disk
+/// @param total_sectors Size of the disk in sectors, or 0 if not known yet
+/// @param driver_data Disk type specific data
+/// @return The new disk, or 0 if the registry is full
+struct disk*
+register_disk(DISK_TYPE type, struct disk_driver* driver, unsigned int total_sectors, void* driver_data)
+{
+    if (disk_count >= MAX_DISK_COUNT) {
+        return 0;
     }
 
-    return ALL_OK;
+    struct disk* disk = &disks[disk_count];
+    memset(disk, 0, sizeof(struct disk));
+    disk->type = type;
+    disk->id = disk_count;
+    disk->sector_size = DISK_SECTOR_SIZE_BYTES;
+    disk->total_sectors = total_sectors;
+    disk->driver = driver;
+    disk->driver_data = driver_data;
+
+    disk_count++;
+    return disk;
 }
 
 void
 initialize_disks()
 {
-    // TODO: Search for disks to initialize
-    memset(&current_disk, 0, sizeof(current_disk));
-    current_disk.type = DISK_TYPE_REAL;
-    current_disk.id = 0;
-    current_disk.sector_size = DISK_SECTOR_SIZE_BYTES;
-    current_disk.fs = fs_resolve(&current_disk);
+    // TODO: Search for disks to initialize. We only probe the master drive on the primary ATA channel for now.
+    memset(disks, 0, sizeof(disks));
+    disk_count = 0;
+
+    initialize_buffer_cache();
+    ide_dma_initialize();
+
+    struct disk* boot_disk = register_disk(DISK_TYPE_REAL, &real_disk_driver, 0, 0);
+    ata_initialize(boot_disk);
+    boot_disk->fs = fs_resolve(boot_disk);
+
+    // Optionally copy the boot disk into memory, so the file system can be used (and measured) at memory speed
+    if (DISK_BOOT_RAMDISK_SECTORS > 0) {
+        struct disk* ramdisk = ramdisk_create_from_disk(boot_disk, DISK_BOOT_RAMDISK_SECTORS);
+        if (ramdisk) {
+            ramdisk->fs = fs_resolve(ramdisk);
+        }
+    }
+}
+
+unsigned int
+get_disk_count()
+{
+    return disk_count;
 }
 
 struct disk*
 get_disk(unsigned int disk_number)
 {
-    // TODO: support more disks. we only have one FAT16 disk for now.
-    if (disk_number != 0) {
+    if (disk_number >= disk_count) {
         return 0;
     }
-    return &current_disk;
+    return &disks[disk_number];
+}
+
+static bool
+disk_is_in_range(struct disk* disk, unsigned int lba, unsigned int total)
+{
+    return !disk->total_sectors || (lba < disk->total_sectors && total <= disk->total_sectors - lba);
 }
 
 status_t
 disk_read_block(struct disk* disk, unsigned int lba, unsigned int total, void* buf)
 {
-    if (disk != &current_disk) {
+    if (!disk || !disk->driver || !disk->driver->read) {
+        return ERROR(EIO);
+    }
+    if (!disk_is_in_range(disk, lba, total)) {
+        return ERROR(EIO);
+    }
+    return disk->driver->read(disk, lba, total, buf);
+}
+
+/// @brief Writes `total` sectors from `buf` to `lba`. On ATA disks, writes of up to
+/// `DISK_BUFFER_CACHE_MAX_FILL_SECTORS` sectors may only be in the buffer cache when this returns, and are written back
+/// later. Larger writes have reached the drive, but may still be in its cache. Call `disk_flush()` to write the buffer
+/// cache out and flush the drive's cache, so the data survives a power loss.
+status_t
+disk_write_block(struct disk* disk, unsigned int lba, unsigned int total, const void* buf)
+{
+    if (!disk || !disk->driver || !disk->driver->write) {
         return ERROR(EIO);
     }
-    return disk_read_sector(lba, total, buf);
+    if (!disk_is_in_range(disk, lba, total)) {
+        return ERROR(EIO);
+    }
+    return disk->driver->write(disk, lba, total, buf);
+}
+
+/// @brief Writes the data cached for the disk back, and makes the drive write its own cache to the media.
+status_t
+disk_flush(struct disk* disk)
+{
+    if (!disk || !disk->driver) {
+        return ERROR(EIO);
+    }
+    if (!disk->driver->flush) {
+        // nothing to flush i.e., RAM disks
+        return ALL_OK;
+    }
+    return disk->driver->flush(disk);
+}
+
+/// @brief Flushes every disk. This is `sync()`.
+/// @return ALL_OK, or the error of the first disk that failed. The other disks are flushed anyway.
+status_t
+disk_flush_all()
+{
+    status_t result = ALL_OK;
+    for (unsigned int i = 0; i < disk_count; i++) {
+        status_t disk_result = disk_flush(&disks[i]);
+        if (disk_result != ALL_OK && result == ALL_OK) {
+            result = disk_result;
+        }
+    }
+    return result;
 }
@@ -4,21 +4,49 @@
 #include "../fs/file.h"
 #include "../status.h"
 
-#define DISK_TYPE_REAL 0;
+#define DISK_TYPE_REAL 0 // ATA drive on the primary channel
+#define DISK_TYPE_RAM  1 // block of kernel memory
 
 typedef unsigned int DISK_TYPE;
 
+// forward declaration
+struct disk;
+typedef status_t (*DISK_READ_FUNCTION)(struct disk* disk, unsigned int lba, unsigned int total, void* buf);
+typedef status_t (*DISK_WRITE_FUNCTION)(struct disk* disk, unsigned int lba, unsigned int total, const void* buf);
+typedef status_t (*DISK_FLUSH_FUNCTION)(struct disk* disk);
+
+// Block device operations of a disk type
+struct disk_driver
+{
+    char name[16];
+    DISK_READ_FUNCTION read;
+    DISK_WRITE_FUNCTION write;
+    // Optional. Makes sure the written data survives a power loss.
+    DISK_FLUSH_FUNCTION flush;
+};
+
 struct disk
 {
     DISK_TYPE type;
     unsigned int id;
     unsigned int sector_size;
+    // Size of the disk in sectors. 0 if unknown.
+    unsigned int total_sectors;
+    // Sectors transferred per DRQ block with READ MULTIPLE. 0 if the drive doesn't support it.
+    unsigned int multiple_sector_count;
+    struct disk_driver* driver;
+    void* driver_data; // disk type specific data i.e., the memory of a RAM disk
     struct file_system* fs;
-    void* private_data; // file system specific data i.e., fs::fat16::fat_private_data
+    void* private_data; // file system specific data i.e., fs::fat::fat_private_data
 };
 
 void initialize_disks();
+struct disk* register_disk(DISK_TYPE type, struct disk_driver* driver, unsigned int total_sectors, void* driver_data);
+unsigned int get_disk_count();
 struct disk* get_disk(unsigned int disk_number);
 status_t disk_read_block(struct disk* disk, unsigned int lba, unsigned int total, void* buf);
+status_t disk_write_block(struct disk* disk, unsigned int lba, unsigned int total, const void* buf);
+status_t disk_flush(struct disk* disk);
+status_t disk_flush_all();
 
 #endif
@@ -0,0 +1,186 @@
+#include "ide_dma.h"
+#include "../io/io.h"
+#include "../memory/memory.h"
+#include "../pci/pci.h"
+#include <stdint.h>
+
+// Bus master IDE registers for the primary channel, relative to BAR4 of the IDE controller.
+// https://wiki.osdev.org/ATA/ATAPI_using_DMA
+#define IDE_BM_REG_COMMAND 0x00
+#define IDE_BM_REG_STATUS  0x02
+#define IDE_BM_REG_PRDT    0x04
+
+#define IDE_BM_COMMAND_START 0x01
+#define IDE_BM_COMMAND_READ  0x08 // direction: the controller writes to memory
+
+#define IDE_BM_STATUS_ACTIVE 0x01
+#define IDE_BM_STATUS_ERROR  0x02
+#define IDE_BM_STATUS_IRQ    0x04 // the drive raised IRQ 14. Write 1 to clear.
+
+#define IDE_PRD_END_OF_TABLE  0x8000
+#define IDE_PRD_MAX_BYTES     0x10000 // a PRD can't cross a 64KB boundary, and 0 in `byte_count` means 64KB
+#define IDE_DMA_MAX_PRD_COUNT 64
+
+// Physical Region Descriptor. Each one describes a physically contiguous buffer the controller transfers data to (or
+// from, for writes).
+struct prd_entry
+{
+    uint32_t physical_address;
+    uint16_t byte_count;
+    uint16_t flags;
+} __attribute__((packed));
+
+// The PRD table must be 4-byte aligned and must not cross a 64KB boundary. Aligning the table to its own size
+// guarantees both. The kernel space is identity mapped, so the virtual address of the table is the physical address.
+static struct prd_entry prd_table[IDE_DMA_MAX_PRD_COUNT]
+  __attribute__((aligned(sizeof(struct prd_entry) * IDE_DMA_MAX_PRD_COUNT)));
+
+static int prd_count = 0;
+// IDE_BM_COMMAND_READ for reads, 0 for writes
+static uint8_t direction = IDE_BM_COMMAND_READ;
+
+static struct pci_device ide_controller;
+static uint16_t bus_master_base = 0;
+
+/// @brief Finds the PCI IDE controller and enables bus mastering. If there is no controller that supports bus-master
+/// DMA (or we are on a machine without PCI), the ATA driver keeps using PIO.
+/// @return ALL_OK if DMA is available.
+status_t
+ide_dma_initialize()
+{
+    bus_master_base = 0;
+
+    status_t result = pci_find_device(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_IDE, &ide_controller);
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    if (!(ide_controller.prog_if & PCI_PROG_IF_BUS_MASTERING)) {
+        return ERROR(EIO);
+    }
+
+    // BAR4 holds the I/O port base of the bus master registers. Bit 0 is set for I/O space BARs.
+    uint32_t bar4 = pci_config_read(&ide_controller, PCI_CONFIG_BAR4);
+    if (!(bar4 & 0x01) || (bar4 & 0xFFFC) == 0) {
+        return ERROR(EIO);
+    }
+
+    uint32_t command = pci_config_read(&ide_controller, PCI_CONFIG_COMMAND);
+    pci_config_write(
+      &ide_controller, PCI_CONFIG_COMMAND, (command & 0xFFFF) | PCI_COMMAND_IO_SPACE | PCI_COMMAND_BUS_MASTER
+    );
+
+    bus_master_base = bar4 & 0xFFFC;
+    outb(bus_master_base + IDE_BM_REG_COMMAND, 0);
+    outb(bus_master_base + IDE_BM_REG_STATUS, IDE_BM_STATUS_ERROR | IDE_BM_STATUS_IRQ);
+
+    return ALL_OK;
+}
+
+bool
+ide_dma_is_available()
+{
+    return bus_master_base != 0;
+}
+
+/// @brief Starts a new, empty PRD table for the next transfer.
+void
+ide_dma_reset()
+{
+    prd_count = 0;
+}
+
+/// @brief Appends `buf` to the PRD table of the next transfer. The controller fills the buffers in the order they
+/// are added, so adjacent disk requests can be read into their own buffers with a single command.
+/// @param buf The buffer to read into. It must be 2-byte aligned.
+/// @param size The number of bytes to read into `buf`.
+/// @return ALL_OK if the buffer can be transferred with DMA. Otherwise the caller should fall back to PIO.
+status_t
+ide_dma_add_buffer(void* buf, unsigned int size)
+{
+    if (!ide_dma_is_available()) {
+        return ERROR(EIO);
+    }
+
+    // Bit 0 of the PRD address is reserved, so the buffer must be word aligned.
+    if (!buf || size == 0 || ((uint32_t)buf & 0x01)) {
+        return ERROR(EINVARG);
+    }
+
+    uint32_t address = (uint32_t)buf;
+    while (size > 0) {
+        if (prd_count == IDE_DMA_MAX_PRD_COUNT) {
+            return ERROR(EINVARG);
+        }
+
+        // Split the buffer at every 64KB boundary.
+        uint32_t bytes_to_boundary = IDE_PRD_MAX_BYTES - (address & (IDE_PRD_MAX_BYTES - 1));
+        uint32_t bytes = size < bytes_to_boundary ? size : bytes_to_boundary;
+
+        prd_table[prd_count].physical_address = address;
+        prd_table[prd_count].byte_count = (uint16_t)(bytes & 0xFFFF);
+        prd_table[prd_count].flags = 0;
+
+        address += bytes;
+        size -= bytes;
+        prd_count++;
+    }
+
+    return ALL_OK;
+}
+
+/// @brief Loads the PRD table built with `ide_dma_add_buffer()` and arms the bus master. The caller sends the ATA DMA
+/// command afterwards, and then calls `ide_dma_start()`.
+/// @param write true if the controller reads the buffers and sends them to the drive, false if it fills them
+void
+ide_dma_arm(bool write)
+{
+    prd_table[prd_count - 1].flags = IDE_PRD_END_OF_TABLE;
+
+    direction = write ? 0 : IDE_BM_COMMAND_READ;
+    outl(bus_master_base + IDE_BM_REG_PRDT, (uint32_t)prd_table);
+    outb(bus_master_base + IDE_BM_REG_COMMAND, direction);
+    // clear the error and interrupt bits from the previous transfer
+    outb(bus_master_base + IDE_BM_REG_STATUS, IDE_BM_STATUS_ERROR | IDE_BM_STATUS_IRQ);
+}
+
+void
+ide_dma_start()
+{
+    outb(bus_master_base + IDE_BM_REG_COMMAND, direction | IDE_BM_COMMAND_START);
+}
+
+/// @brief Checks whether the transfer started by `ide_dma_start()` has finished. The IRQ bit of the bus master status
+/// register is set when the drive asserts IRQ 14, so this also tells us whether an IRQ 14 is ours.
+bool
+ide_dma_is_complete()
+{
+    uint8_t status = inb(bus_master_base + IDE_BM_REG_STATUS);
+    return (status & (IDE_BM_STATUS_IRQ | IDE_BM_STATUS_ERROR)) != 0;
+}
+
+/// @brief Stops the bus master after the transfer has completed.
+/// @return ALL_OK if the transfer completed without errors.
+status_t
+ide_dma_finish()
+{
+    uint8_t status = inb(bus_master_base + IDE_BM_REG_STATUS);
+
+    outb(bus_master_base + IDE_BM_REG_COMMAND, 0);
+    outb(bus_master_base + IDE_BM_REG_STATUS, IDE_BM_STATUS_ERROR | IDE_BM_STATUS_IRQ);
+
+    if (status & IDE_BM_STATUS_ERROR) {
+        return ERROR(EIO);
+    }
+    return ALL_OK;
+}
+
+/// @brief Clears the interrupt bit of the bus master status register. Called for an IRQ 14 without a request in flight.
+void
+ide_dma_acknowledge_interrupt()
+{
+    if (!ide_dma_is_available()) {
+        return;
+    }
+    outb(bus_master_base + IDE_BM_REG_STATUS, IDE_BM_STATUS_IRQ);
+}
@@ -0,0 +1,17 @@
+#ifndef IDE_DMA_H
+#define IDE_DMA_H
+
+#include "../status.h"
+#include <stdbool.h>
+
+status_t ide_dma_initialize();
+bool ide_dma_is_available();
+void ide_dma_reset();
+status_t ide_dma_add_buffer(void* buf, unsigned int size);
+void ide_dma_arm(bool write);
+void ide_dma_start();
+bool ide_dma_is_complete();
+status_t ide_dma_finish();
+void ide_dma_acknowledge_interrupt();
+
+#endif
@@ -0,0 +1,204 @@
+#include "queue.h"
+#include "../memory/memory.h"
+#include "../task/task.h"
+#include "ata.h"
+#include "scheduler.h"
+
+// The request (chain) the drive is working on. Everything else waits in the scheduler.
+static struct disk_request* in_flight = 0;
+
+// The task blocked in `disk_queue_flush()` until every queued request has completed, or 0
+static struct task* drain_waiter = 0;
+
+static void
+disk_queue_complete(struct disk_request* request, status_t result)
+{
+    while (request) {
+        struct disk_request* next = request->merge_next;
+        request->merge_next = 0;
+        request->result = result;
+        request->state = DISK_REQUEST_STATE_COMPLETE;
+        if (request->waiter) {
+            task_wake(request->waiter);
+            request->waiter = 0;
+        }
+        request = next;
+    }
+}
+
+// Sends the next request chosen by the scheduler to the drive. Requests that fail to start are completed right away.
+static void
+disk_queue_dispatch()
+{
+    while (!in_flight) {
+        struct disk_request* request = disk_scheduler_next();
+        if (!request) {
+            return;
+        }
+
+        for (struct disk_request* merged = request; merged; merged = merged->merge_next) {
+            merged->state = DISK_REQUEST_STATE_IN_FLIGHT;
+        }
+
+        status_t result = ata_start_request(request);
+        if (result != ALL_OK) {
+            disk_queue_complete(request, result);
+            continue;
+        }
+        in_flight = request;
+    }
+}
+
+/// @brief Adds the request to the queue. If the drive is idle, the request is sent to the drive right away. This
+/// function doesn't wait for the request to complete. Call `disk_queue_wait()` for that.
+/// @param request The request to submit. It must stay alive until it completes.
+void
+disk_queue_submit(struct disk_request* request)
+{
+    request->transferred = 0;
+    request->result = ALL_OK;
+    request->state = DISK_REQUEST_STATE_QUEUED;
+    request->next = 0;
+    request->merge_next = 0;
+    request->waiter = 0;
+
+    if (request->total == 0) {
+        request->state = DISK_REQUEST_STATE_COMPLETE;
+        return;
+    }
+
+    disk_scheduler_add(request);
+    disk_queue_dispatch();
+}
+
+/// @brief Waits for the request to complete. The current task is parked on the request and the other tasks run until
+/// the IRQ 14 handler completes it and wakes the task up. During boot, before any task runs, the CPU halts instead.
+/// @param request A submitted request
+/// @return The result of the request
+status_t
+disk_queue_wait(struct disk_request* request)
+{
+    disk_queue_poll();
+    while (request->state != DISK_REQUEST_STATE_COMPLETE) {
+        request->waiter = get_current_task();
+        task_block();
+        disk_queue_poll();
+    }
+    return request->result;
+}
+
+/// @brief Reads `total` sectors from `lba` into `buf` and waits for the read to complete. The request is dispatched as
+/// soon as the drive is idle, so it only gets reordered behind requests that were already queued.
+status_t
+disk_queue_read(struct disk* disk, unsigned int lba, unsigned int total, void* buf)
+{
+    struct disk_request request;
+    memset(&request, 0, sizeof(request));
+    request.disk = disk;
+    request.lba = lba;
+    request.total = total;
+    request.buf = buf;
+
+    disk_queue_submit(&request);
+    return disk_queue_wait(&request);
+}
+
+/// @brief Writes `total` sectors from `buf` to `lba` and waits for the write to complete. The data may still be in the
+/// drive's write cache. Call `disk_queue_flush()` to make sure it reached the media.
+status_t
+disk_queue_write(struct disk* disk, unsigned int lba, unsigned int total, const void* buf)
+{
+    struct disk_request request;
+    memset(&request, 0, sizeof(request));
+    request.type = DISK_REQUEST_TYPE_WRITE;
+    request.disk = disk;
+    request.lba = lba;
+    request.total = total;
+    request.buf = (void*)buf;
+
+    disk_queue_submit(&request);
+    return disk_queue_wait(&request);
+}
+
+/// @brief Waits for every request in the queue to complete, then makes the drive write its cache to the media. The
+/// scheduler reorders requests, so the flush is a barrier: nothing is dispatched while it's in flight.
+status_t
+disk_queue_flush(struct disk* disk)
+{
+    disk_queue_poll();
+    while (in_flight || !disk_scheduler_is_empty()) {
+        drain_waiter = get_current_task();
+        task_block();
+        disk_queue_poll();
+    }
+
+    struct disk_request request;
+    memset(&request, 0, sizeof(request));
+    request.type = DISK_REQUEST_TYPE_FLUSH;
+    request.disk = disk;
+    request.state = DISK_REQUEST_STATE_IN_FLIGHT;
+
+    status_t result = ata_start_request(&request);
+    if (result != ALL_OK) {
+        return result;
+    }
+    in_flight = &request;
+
+    return disk_queue_wait(&request);
+}
+
+// The command for the current chunk of the in-flight request has finished. Issues the next chunk of a large request,
+// or completes the request and dispatches the next one.
+static void
+disk_queue_finish_command(struct disk_request* request)
+{
+    if (request->result == ALL_OK && !request->merge_next && request->transferred < request->total) {
+        // issue the next chunk of a large request
+        status_t result = ata_start_request(request);
+        if (result == ALL_OK) {
+            return;
+        }
+        request->result = result;
+    }
+
+    in_flight = 0;
+    disk_queue_complete(request, request->result);
+    disk_queue_dispatch();
+
+    if (drain_waiter && !in_flight && disk_scheduler_is_empty()) {
+        task_wake(drain_waiter);
+        drain_waiter = 0;
+    }
+}
+
+/// @brief Sends the first block of the in-flight PIO write if the drive wasn't ready for it when the command was sent.
+/// The drive raises no interrupt until it gets that block, so this is called on every clock tick and by the waiters
+/// before they block. It never waits for the drive.
+void
+disk_queue_poll()
+{
+    struct disk_request* request = in_flight;
+    if (request && ata_poll_request(request)) {
+        disk_queue_finish_command(request);
+    }
+}
+
+/// @brief IRQ 14 handler. Advances the request the drive is working on, and dispatches the next request when it
+/// completes.
+void*
+disk_interrupt_handler(struct interrupt_frame* frame)
+{
+    struct disk_request* request = in_flight;
+    if (!request) {
+        ata_acknowledge_interrupt();
+        return 0;
+    }
+
+    if (!ata_handle_interrupt(request)) {
+        // the command is still in progress
+        return 0;
+    }
+
+    disk_queue_finish_command(request);
+    return 0;
+}
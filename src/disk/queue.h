@@ -0,0 +1,72 @@
+#ifndef DISK_QUEUE_H
+#define DISK_QUEUE_H
+
+#include "../idt/idt.h"
+#include "../status.h"
+#include "disk.h"
+#include <stdbool.h>
+
+// forward declaration
+struct task;
+
+enum DISK_REQUEST_STATE
+{
+    DISK_REQUEST_STATE_QUEUED = 0,
+    DISK_REQUEST_STATE_IN_FLIGHT,
+    DISK_REQUEST_STATE_COMPLETE,
+};
+
+enum DISK_REQUEST_TYPE
+{
+    DISK_REQUEST_TYPE_READ = 0,
+    DISK_REQUEST_TYPE_WRITE,
+    // Makes the drive write its internal cache to the media. It has no sectors, and it isn't scheduled (see
+    // `disk_queue_flush()`).
+    DISK_REQUEST_TYPE_FLUSH,
+};
+
+// A read or write of `total` sectors starting at `lba`. Requests are ordered (and merged) by the disk scheduler and
+// served one command at a time by the drive. They are completed by the IRQ 14 handler, so the submitter is free to do
+// something else until it needs the data (or, for writes, until it needs to know the data is on the disk). The
+// scheduler only sees the requests submitted before anybody waits: the buffer cache readahead and write-back, and the
+// pieces a reader prefetches. `disk_queue_read()` and `disk_queue_write()` wait right away, so their requests are
+// never merged with each other.
+struct disk_request
+{
+    enum DISK_REQUEST_TYPE type;
+    struct disk* disk;
+    unsigned int lba;
+    unsigned int total;
+    void* buf;
+
+    // Sectors transferred so far
+    unsigned int transferred;
+    // A request larger than what a single ATA command can transfer is issued in chunks. These describe the command in
+    // flight and are only used on the first request of a merged chain.
+    unsigned int command_total;
+    unsigned int command_transferred;
+    bool dma;
+
+    // Updated from the interrupt handler
+    volatile enum DISK_REQUEST_STATE state;
+    status_t result;
+    // The task blocked in `disk_queue_wait()` until the request completes, or 0
+    struct task* waiter;
+
+    // The scheduler's pending list
+    struct disk_request* next;
+    // Adjacent requests of the same type merged into this one. They are transferred with the same command.
+    struct disk_request* merge_next;
+    // The scheduler dispatches the request once this many dispatches have been made, even if the elevator is elsewhere.
+    unsigned int deadline;
+};
+
+void disk_queue_submit(struct disk_request* request);
+status_t disk_queue_wait(struct disk_request* request);
+status_t disk_queue_read(struct disk* disk, unsigned int lba, unsigned int total, void* buf);
+status_t disk_queue_write(struct disk* disk, unsigned int lba, unsigned int total, const void* buf);
+status_t disk_queue_flush(struct disk* disk);
+void disk_queue_poll();
+void* disk_interrupt_handler(struct interrupt_frame* frame);
+
+#endif
@@ -0,0 +1,98 @@
+#include "ramdisk.h"
+#include "../config.h"
+#include "../memory/heap/kheap.h"
+#include "../memory/memory.h"
+
+// A RAM disk is a block of kernel memory. Reads and writes are a copy, so they skip the buffer cache and the disk queue.
+static status_t
+ramdisk_read(struct disk* disk, unsigned int lba, unsigned int total, void* buf)
+{
+    char* data = (char*)disk->driver_data;
+    memcpy(buf, data + lba * DISK_SECTOR_SIZE_BYTES, total * DISK_SECTOR_SIZE_BYTES);
+    return ALL_OK;
+}
+
+static status_t
+ramdisk_write(struct disk* disk, unsigned int lba, unsigned int total, const void* buf)
+{
+    char* data = (char*)disk->driver_data;
+    memcpy(data + lba * DISK_SECTOR_SIZE_BYTES, buf, total * DISK_SECTOR_SIZE_BYTES);
+    return ALL_OK;
+}
+
+static struct disk_driver ramdisk_driver = {
+    .name = "RAMDISK",
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+};
+
+/// @brief Registers a RAM disk backed by `data`. The memory must stay alive as long as the disk is in use.
+/// @param data The disk image
+/// @param total_sectors Size of the image in sectors
+/// @return The new disk, or 0 if the disk registry is full
+struct disk*
+ramdisk_create_from_memory(void* data, unsigned int total_sectors)
+{
+    if (!data || total_sectors == 0) {
+        return 0;
+    }
+    return register_disk(DISK_TYPE_RAM, &ramdisk_driver, total_sectors, data);
+}
+
+/// @brief Registers an empty (zero-filled) RAM disk.
+/// @param total_sectors Size of the disk in sectors
+/// @return The new disk, or 0 on error
+struct disk*
+ramdisk_create(unsigned int total_sectors)
+{
+    if (total_sectors == 0) {
+        return 0;
+    }
+
+    void* data = kzalloc(total_sectors * DISK_SECTOR_SIZE_BYTES);
+    if (!data) {
+        return 0;
+    }
+
+    struct disk* disk = ramdisk_create_from_memory(data, total_sectors);
+    if (!disk) {
+        kfree(data);
+    }
+    return disk;
+}
+
+/// @brief Registers a RAM disk holding a copy of the first `total_sectors` sectors of `source`.
+/// @param source The disk to copy
+/// @param total_sectors Sectors to copy. It's clamped to the size of `source` if that is known.
+/// @return The new disk, or 0 on error
+struct disk*
+ramdisk_create_from_disk(struct disk* source, unsigned int total_sectors)
+{
+    if (!source) {
+        return 0;
+    }
+    if (source->total_sectors && total_sectors > source->total_sectors) {
+        total_sectors = source->total_sectors;
+    }
+
+    struct disk* disk = ramdisk_create(total_sectors);
+    if (!disk) {
+        return 0;
+    }
+
+    // Large reads bypass the buffer cache, so the copy doesn't push out the metadata of the source disk
+    char* data = (char*)disk->driver_data;
+    for (unsigned int lba = 0; lba < total_sectors; lba += DISK_SCHEDULER_MAX_MERGE_SECTORS) {
+        unsigned int total = total_sectors - lba;
+        if (total > DISK_SCHEDULER_MAX_MERGE_SECTORS) {
+            total = DISK_SCHEDULER_MAX_MERGE_SECTORS;
+        }
+
+        if (disk_read_block(source, lba, total, data + lba * DISK_SECTOR_SIZE_BYTES) != ALL_OK) {
+            // The disk is registered already. Keep it with the sectors we couldn't read left as zeros.
+            break;
+        }
+    }
+
+    return disk;
+}
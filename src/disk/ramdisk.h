@@ -0,0 +1,10 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "disk.h"
+
+struct disk* ramdisk_create(unsigned int total_sectors);
+struct disk* ramdisk_create_from_memory(void* data, unsigned int total_sectors);
+struct disk* ramdisk_create_from_disk(struct disk* source, unsigned int total_sectors);
+
+#endif
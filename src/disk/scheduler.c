@@ -0,0 +1,110 @@
+#include "scheduler.h"
+#include "../config.h"
+
+// Requests waiting to be dispatched, sorted by LBA
+static struct disk_request* pending_head = 0;
+
+// The LBA right after the last dispatched request. The elevator keeps moving up from here.
+static unsigned int head_position = 0;
+
+// Number of dispatches so far. Used as the clock for the request deadlines.
+static unsigned int dispatch_count = 0;
+
+/// @brief Adds the request to the pending list. The list is kept sorted by LBA so that the elevator can sweep it in
+/// order and adjacent requests sit next to each other.
+/// @param request The request to add
+void
+disk_scheduler_add(struct disk_request* request)
+{
+    request->deadline = dispatch_count + DISK_SCHEDULER_DEADLINE;
+    request->merge_next = 0;
+
+    struct disk_request** slot = &pending_head;
+    while (*slot && (*slot)->lba <= request->lba) {
+        slot = &(*slot)->next;
+    }
+    request->next = *slot;
+    *slot = request;
+}
+
+// C-LOOK: the first request at or above the head position. Once the head passes the last request, it wraps around to
+// the lowest LBA. A request that has waited past its deadline is served first so that a stream of nearby requests
+// can't starve it.
+static struct disk_request*
+pick_request()
+{
+    struct disk_request* expired = 0;
+    struct disk_request* above_head = 0;
+
+    for (struct disk_request* request = pending_head; request; request = request->next) {
+        if ((int)(dispatch_count - request->deadline) >= 0 && (!expired || request->deadline < expired->deadline)) {
+            expired = request;
+        }
+        if (!above_head && request->lba >= head_position) {
+            above_head = request;
+        }
+    }
+
+    if (expired) {
+        return expired;
+    }
+    return above_head ? above_head : pending_head;
+}
+
+static bool
+can_merge(struct disk_request* last, struct disk_request* next, unsigned int merged_sectors, int merged_requests)
+{
+    return next && next->type == last->type && next->disk == last->disk && next->lba == last->lba + last->total &&
+           merged_sectors + next->total <= DISK_SCHEDULER_MAX_MERGE_SECTORS &&
+           merged_requests < DISK_SCHEDULER_MAX_MERGE_REQUESTS;
+}
+
+/// @brief Removes the next request to send to the drive from the pending list. Requests of the same type that continue
+/// where the picked one ends are merged into it and chained with `merge_next`, so that they are transferred with a
+/// single command.
+/// @return The first request of the chain, or 0 if there is nothing to do.
+struct disk_request*
+disk_scheduler_next()
+{
+    struct disk_request* first = pick_request();
+    if (!first) {
+        return 0;
+    }
+
+    // The list is sorted by LBA, so the requests adjacent to `first` follow it in the list. Requests too large for a
+    // single command are never merged.
+    struct disk_request* last = first;
+    unsigned int merged_sectors = first->total;
+    int merged_requests = 1;
+    if (merged_sectors <= DISK_SCHEDULER_MAX_MERGE_SECTORS) {
+        while (can_merge(last, last->next, merged_sectors, merged_requests)) {
+            last->merge_next = last->next;
+            last = last->next;
+            merged_sectors += last->total;
+            merged_requests++;
+        }
+    }
+
+    // unlink the chain from the pending list
+    struct disk_request* after = last->next;
+    last->next = 0;
+    struct disk_request** slot = &pending_head;
+    while (*slot != first) {
+        slot = &(*slot)->next;
+    }
+    *slot = after;
+    for (struct disk_request* request = first; request; request = request->merge_next) {
+        request->next = 0;
+    }
+
+    head_position = first->lba + merged_sectors;
+    dispatch_count++;
+
+    return first;
+}
+
+bool
+disk_scheduler_is_empty()
+{
+    return pending_head == 0;
+}
@@ -0,0 +1,11 @@
+#ifndef DISK_SCHEDULER_H
+#define DISK_SCHEDULER_H
+
+#include "queue.h"
+#include <stdbool.h>
+
+void disk_scheduler_add(struct disk_request* request);
+struct disk_request* disk_scheduler_next();
+bool disk_scheduler_is_empty();
+
+#endif
@@ -1,6 +1,9 @@
 #include "stream.h"
 #include "../config.h"
 #include "../memory/heap/kheap.h"
+#include "../memory/memory.h"
+#include "buffer_cache.h"
+#include <stdbool.h>
 
 struct disk_stream*
 disk_stream_open(int disk_number)
@@ -17,34 +20,210 @@ disk_stream_open(int disk_number)
     return stream;
 }
 
+/// @brief Moves the stream to the byte `position` on the disk. Positions are 64-bit, so a stream reaches every sector of
+/// the disk and not only the first 4GB.
 status_t
-disk_stream_seek(struct disk_stream* stream, unsigned int position)
+disk_stream_seek(struct disk_stream* stream, uint64_t position)
 {
     stream->sector = position / DISK_SECTOR_SIZE_BYTES;
     stream->offset = position % DISK_SECTOR_SIZE_BYTES;
     return ALL_OK;
 }
 
+// Moves the stream position forward by `size` bytes within the current sector
+static void
+disk_stream_advance(struct disk_stream* stream, unsigned int size)
+{
+    stream->offset += size;
+    if (stream->offset == DISK_SECTOR_SIZE_BYTES) {
+        stream->sector++;
+        stream->offset = 0;
+    }
+}
+
+// Reads the partial sector at the stream position through a bounce buffer
+static status_t
+disk_stream_read_partial(struct disk_stream* stream, char* buf, unsigned int size)
+{
+    char block[DISK_SECTOR_SIZE_BYTES];
+
+    status_t result = disk_read_block(stream->disk, stream->sector, 1, block);
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    memcpy(buf, block + stream->offset, size);
+    disk_stream_advance(stream, size);
+    return ALL_OK;
+}
+
+// Writes the partial sector at the stream position. The rest of the sector is read first so that it's preserved.
+static status_t
+disk_stream_write_partial(struct disk_stream* stream, const char* buf, unsigned int size)
+{
+    char block[DISK_SECTOR_SIZE_BYTES];
+
+    status_t result = disk_read_block(stream->disk, stream->sector, 1, block);
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    memcpy(block + stream->offset, buf, size);
+
+    result = disk_write_block(stream->disk, stream->sector, 1, block);
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    disk_stream_advance(stream, size);
+    return ALL_OK;
+}
+
+// Called after every successful read that started at `start_sector`. Sequential reads double the readahead window, and
+// keep the sectors after the stream position on their way into the buffer cache. Anything else turns readahead off
+// until the stream is read sequentially again.
+static void
+disk_stream_readahead(struct disk_stream* stream, unsigned int start_sector)
+{
+    // Only ATA disks go through the buffer cache. Everything else is as fast as memory anyway.
+    if (stream->disk->type != DISK_TYPE_REAL) {
+        return;
+    }
+
+    bool sequential = start_sector >= stream->last_read_sector && start_sector <= stream->next_read_sector;
+    stream->last_read_sector = start_sector;
+    stream->next_read_sector = stream->sector;
+
+    if (!sequential) {
+        stream->readahead_window = 0;
+        stream->readahead_end = 0;
+        return;
+    }
+
+    if (stream->readahead_window == 0) {
+        stream->readahead_window = DISK_READAHEAD_MIN_SECTORS;
+    } else if (stream->readahead_window < DISK_READAHEAD_MAX_SECTORS) {
+        stream->readahead_window *= 2;
+    }
+
+    // The sector the stream is in the middle of has already been read
+    unsigned int from = stream->offset ? stream->sector + 1 : stream->sector;
+    if (stream->readahead_end > from) {
+        from = stream->readahead_end;
+    }
+    unsigned int to = stream->sector + stream->readahead_window;
+
+    // Top the window up only once half of it has been consumed, so that the prefetches are large enough to be worth a
+    // command of their own
+    if (from + stream->readahead_window / 2 > to) {
+        return;
+    }
+
+    buffer_cache_prefetch(stream->disk, from, to - from);
+    stream->readahead_end = to;
+}
+
+/// @brief Starts reading the sectors that hold `size` bytes at `position` into the buffer cache, and returns without
+/// waiting. The stream position doesn't move. A reader of scattered pieces prefetches them all before reading the first,
+/// so the disk scheduler gets the requests together and orders them, instead of one at a time.
+void
+disk_stream_prefetch(struct disk_stream* stream, uint64_t position, unsigned int size)
+{
+    // Only ATA disks go through the buffer cache
+    if (stream->disk->type != DISK_TYPE_REAL || size == 0) {
+        return;
+    }
+
+    unsigned int first_sector = position / DISK_SECTOR_SIZE_BYTES;
+    unsigned int last_sector = (position + size - 1) / DISK_SECTOR_SIZE_BYTES;
+    buffer_cache_prefetch(stream->disk, first_sector, last_sector - first_sector + 1);
+}
+
+/// @brief Reads `size` bytes from the stream position into `buf`, and moves the position forward. The whole sectors in
+/// the middle of the range are read straight into `buf` with a single `disk_read_block()`. Only the unaligned head and
+/// tail go through a bounce sector. Sequential reads prefetch the sectors that follow (see `disk_stream_readahead()`).
 status_t
 disk_stream_read(struct disk_stream* stream, char* buf, unsigned int size)
 {
-    char block[DISK_SECTOR_SIZE_BYTES];
     status_t result = ERROR(EINVARG);
+    unsigned int start_sector = stream->sector;
+
+    // head: the rest of the sector the stream is in the middle of
+    if (size > 0 && stream->offset != 0) {
+        unsigned int head = DISK_SECTOR_SIZE_BYTES - stream->offset;
+        if (head > size) {
+            head = size;
+        }
+        result = disk_stream_read_partial(stream, buf, head);
+        if (result != ALL_OK) {
+            goto out;
+        }
+        buf += head;
+        size -= head;
+    }
 
-    for (int i = 0; i < size; i++) {
-        if (stream->offset == 0 || i == 0) {
-            result = disk_read_block(stream->disk, stream->sector, 1, block);
-            if (result != ALL_OK) {
-                goto out;
-            }
+    // body: whole sectors
+    unsigned int sectors = size / DISK_SECTOR_SIZE_BYTES;
+    if (sectors > 0) {
+        result = disk_read_block(stream->disk, stream->sector, sectors, buf);
+        if (result != ALL_OK) {
+            goto out;
         }
+        stream->sector += sectors;
+        buf += sectors * DISK_SECTOR_SIZE_BYTES;
+        size -= sectors * DISK_SECTOR_SIZE_BYTES;
+    }
 
-        buf[i] = block[stream->offset++];
+    // tail: the beginning of the last sector
+    if (size > 0) {
+        result = disk_stream_read_partial(stream, buf, size);
+    }
 
-        if (stream->offset == DISK_SECTOR_SIZE_BYTES) {
-            stream->sector++;
-            stream->offset = 0;
+    if (result == ALL_OK) {
+        disk_stream_readahead(stream, start_sector);
+    }
+
+out:
+    return result;
+}
+
+/// @brief Writes `size` bytes from `buf` at the stream position, and moves the position forward. Like
+/// `disk_stream_read()`, the whole sectors in the middle are written straight from `buf` with a single
+/// `disk_write_block()`. The unaligned head and tail are merged with the data already on the disk.
+status_t
+disk_stream_write(struct disk_stream* stream, const char* buf, unsigned int size)
+{
+    status_t result = ERROR(EINVARG);
+
+    // head: the rest of the sector the stream is in the middle of
+    if (size > 0 && stream->offset != 0) {
+        unsigned int head = DISK_SECTOR_SIZE_BYTES - stream->offset;
+        if (head > size) {
+            head = size;
+        }
+        result = disk_stream_write_partial(stream, buf, head);
+        if (result != ALL_OK) {
+            goto out;
+        }
+        buf += head;
+        size -= head;
+    }
+
+    // body: whole sectors
+    unsigned int sectors = size / DISK_SECTOR_SIZE_BYTES;
+    if (sectors > 0) {
+        result = disk_write_block(stream->disk, stream->sector, sectors, buf);
+        if (result != ALL_OK) {
+            goto out;
         }
+        stream->sector += sectors;
+        buf += sectors * DISK_SECTOR_SIZE_BYTES;
+        size -= sectors * DISK_SECTOR_SIZE_BYTES;
+    }
+
+    // tail: the beginning of the last sector
+    if (size > 0) {
+        result = disk_stream_write_partial(stream, buf, size);
     }
 
 out:
@@ -3,17 +3,28 @@
 
 #include "../status.h"
 #include "disk.h"
+#include <stdint.h>
 
 struct disk_stream
 {
     struct disk* disk;
     unsigned int sector;
     unsigned int offset;
+
+    // Readahead state. A read is sequential if it starts where the previous one ended (or in the same sector).
+    unsigned int last_read_sector;
+    unsigned int next_read_sector;
+    // Sectors to keep prefetched past the stream position. 0 until the stream is read sequentially.
+    unsigned int readahead_window;
+    // The sector after the last one prefetched
+    unsigned int readahead_end;
 };
 
 struct disk_stream* disk_stream_open(int disk_number);
-status_t disk_stream_seek(struct disk_stream* stream, unsigned int position);
+status_t disk_stream_seek(struct disk_stream* stream, uint64_t position);
+void disk_stream_prefetch(struct disk_stream* stream, uint64_t position, unsigned int size);
 status_t disk_stream_read(struct disk_stream* stream, char* buf, unsigned int size);
+status_t disk_stream_write(struct disk_stream* stream, const char* buf, unsigned int size);
 void disk_stream_close(struct disk_stream* stream);
 
 #endif
@@ -0,0 +1,190 @@
+#include "dentry.h"
+#include "../memory/memory.h"
+#include "../string/string.h"
+
+static struct dentry dentries[DENTRY_CACHE_SIZE];
+static struct dentry* hash_table[DENTRY_CACHE_HASH_BUCKETS];
+static struct dentry* lru_head = 0;
+static struct dentry* lru_tail = 0;
+
+// 0 is the root directory, and the IDs after it are handed out in order
+static uint32_t next_id = DENTRY_ROOT_ID + 1;
+
+static unsigned int
+hash(struct disk* disk, uint32_t parent_id, const char* name)
+{
+    unsigned int value = disk->id * 31 + parent_id;
+    for (const char* c = name; *c; c++) {
+        value = value * 31 + (unsigned char)*c;
+    }
+    return value & (DENTRY_CACHE_HASH_BUCKETS - 1);
+}
+
+static void
+lru_remove(struct dentry* dentry)
+{
+    if (dentry->lru_prev) {
+        dentry->lru_prev->lru_next = dentry->lru_next;
+    } else {
+        lru_head = dentry->lru_next;
+    }
+
+    if (dentry->lru_next) {
+        dentry->lru_next->lru_prev = dentry->lru_prev;
+    } else {
+        lru_tail = dentry->lru_prev;
+    }
+
+    dentry->lru_prev = 0;
+    dentry->lru_next = 0;
+}
+
+static void
+lru_push_front(struct dentry* dentry)
+{
+    dentry->lru_prev = 0;
+    dentry->lru_next = lru_head;
+    if (lru_head) {
+        lru_head->lru_prev = dentry;
+    } else {
+        lru_tail = dentry;
+    }
+    lru_head = dentry;
+}
+
+static void
+lru_push_back(struct dentry* dentry)
+{
+    dentry->lru_next = 0;
+    dentry->lru_prev = lru_tail;
+    if (lru_tail) {
+        lru_tail->lru_next = dentry;
+    } else {
+        lru_head = dentry;
+    }
+    lru_tail = dentry;
+}
+
+static void
+hash_remove(struct dentry* dentry)
+{
+    struct dentry** slot = &hash_table[hash(dentry->disk, dentry->parent_id, dentry->name)];
+    while (*slot && *slot != dentry) {
+        slot = &(*slot)->hash_next;
+    }
+    if (*slot) {
+        *slot = dentry->hash_next;
+    }
+    dentry->hash_next = 0;
+}
+
+// Drops the entry and puts it at the end of the LRU list, so that it's reused first
+static void
+release(struct dentry* dentry)
+{
+    hash_remove(dentry);
+    dentry->disk = 0;
+    lru_remove(dentry);
+    lru_push_back(dentry);
+}
+
+void
+initialize_dentry_cache()
+{
+    memset(dentries, 0, sizeof(dentries));
+    memset(hash_table, 0, sizeof(hash_table));
+    lru_head = 0;
+    lru_tail = 0;
+    next_id = DENTRY_ROOT_ID + 1;
+
+    for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        lru_push_front(&dentries[i]);
+    }
+}
+
+/// @brief Looks up `name` in the directory `parent_id`.
+/// @return The cached entry (check `negative`), or 0 if the name has not been looked up yet. The entry stays valid until
+/// the next `dentry_add()`.
+struct dentry*
+dentry_lookup(struct disk* disk, uint32_t parent_id, const char* name)
+{
+    if (parent_id == DENTRY_INVALID_ID) {
+        return 0;
+    }
+
+    for (struct dentry* dentry = hash_table[hash(disk, parent_id, name)]; dentry; dentry = dentry->hash_next) {
+        if (dentry->disk == disk && dentry->parent_id == parent_id &&
+            strncmp(dentry->name, name, DENTRY_NAME_LENGTH) == 0) {
+            if (dentry != lru_head) {
+                lru_remove(dentry);
+                lru_push_front(dentry);
+            }
+            return dentry;
+        }
+    }
+    return 0;
+}
+
+/// @brief Caches the result of looking up `name` in the directory `parent_id`. The least recently used entry is
+/// evicted to make room.
+/// @param data The file system's directory entry, or 0 if the name doesn't exist (a negative entry)
+/// @param size The size of `data`. At most `DENTRY_DATA_SIZE`.
+/// @return The new entry, or 0 if the name can't be cached (too long, or the parent isn't cached)
+struct dentry*
+dentry_add(struct disk* disk, uint32_t parent_id, const char* name, const void* data, size_t size)
+{
+    if (parent_id == DENTRY_INVALID_ID || size > DENTRY_DATA_SIZE || strlen(name) >= DENTRY_NAME_LENGTH) {
+        return 0;
+    }
+
+    dentry_invalidate(disk, parent_id, name);
+
+    struct dentry* dentry = lru_tail;
+    if (dentry->disk) {
+        hash_remove(dentry);
+    }
+
+    memset(dentry->data, 0, sizeof(dentry->data));
+    dentry->disk = disk;
+    dentry->id = next_id++;
+    if (next_id == DENTRY_INVALID_ID) {
+        next_id = DENTRY_ROOT_ID + 1;
+    }
+    dentry->parent_id = parent_id;
+    strncpy(dentry->name, name, sizeof(dentry->name) - 1);
+    dentry->name[sizeof(dentry->name) - 1] = 0;
+    dentry->negative = data == 0;
+    if (data) {
+        memcpy(dentry->data, data, size);
+    }
+
+    unsigned int bucket = hash(disk, parent_id, name);
+    dentry->hash_next = hash_table[bucket];
+    hash_table[bucket] = dentry;
+
+    lru_remove(dentry);
+    lru_push_front(dentry);
+    return dentry;
+}
+
+/// @brief Drops the cached result for `name` in the directory `parent_id`. File systems call this when they create,
+/// rename or delete the item.
+void
+dentry_invalidate(struct disk* disk, uint32_t parent_id, const char* name)
+{
+    struct dentry* dentry = dentry_lookup(disk, parent_id, name);
+    if (dentry) {
+        release(dentry);
+    }
+}
+
+/// @brief Drops every cached entry of the disk.
+void
+dentry_invalidate_disk(struct disk* disk)
+{
+    for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        if (dentries[i].disk == disk) {
+            release(&dentries[i]);
+        }
+    }
+}
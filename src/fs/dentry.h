@@ -0,0 +1,39 @@
+#ifndef DENTRY_H
+#define DENTRY_H
+
+#include "../config.h"
+#include "../disk/disk.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DENTRY_ROOT_ID    0          // parent ID of the items in the root directory
+#define DENTRY_INVALID_ID 0xFFFFFFFF // an item that isn't cached. Its children can't be cached either.
+
+// A cached result of looking up `name` in the directory `parent_id` of a disk. The file system stores its own
+// directory entry in `data` (i.e., a FAT directory item). Negative entries remember that the name doesn't exist.
+struct dentry
+{
+    struct disk* disk;
+    // Unique for the lifetime of the cache, so a child never finds the wrong parent after the parent is evicted
+    uint32_t id;
+    uint32_t parent_id;
+    char name[DENTRY_NAME_LENGTH];
+    bool negative;
+    uint8_t data[DENTRY_DATA_SIZE];
+
+    // entries in the same hash bucket
+    struct dentry* hash_next;
+
+    // LRU list. The head is the most recently used entry, and the tail is the next one to be evicted.
+    struct dentry* lru_prev;
+    struct dentry* lru_next;
+};
+
+void initialize_dentry_cache();
+struct dentry* dentry_lookup(struct disk* disk, uint32_t parent_id, const char* name);
+struct dentry* dentry_add(struct disk* disk, uint32_t parent_id, const char* name, const void* data, size_t size);
+void dentry_invalidate(struct disk* disk, uint32_t parent_id, const char* name);
+void dentry_invalidate_disk(struct disk* disk);
+
+#endif
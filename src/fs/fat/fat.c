@@ -0,0 +1,2922 @@
+#include "fat.h"
+#include "../../config.h"
+#include "../../disk/disk.h"
+#include "../../disk/stream.h"
+#include "../../memory/heap/kheap.h"
+#include "../../memory/memory.h"
+#include "../../status.h"
+#include "../../string/string.h"
+#include "../dentry.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define FAT16_SIGNATURE      0x29 // see boot.asm Extended BPB
+#define FAT16_FAT_ENTRY_SIZE 2    // is this FATCopies?
+#define FAT16_BAD_SECTOR     0xFFF7
+#define FAT16_UNUSED_SECTOR  0x0000
+#define FAT16_RESERVED_FIRST 0xFFF0 // 0xFFF0-0xFFF6 are reserved values
+#define FAT16_END_OF_CHAIN   0xFFF8 // 0xFFF8-0xFFFF mark the last cluster of a file
+
+// Values of the in-memory FAT, which holds FAT16 entries widened to the FAT32 format
+#define FAT_UNUSED_CLUSTER 0x00000000
+
+#define FAT32_SIGNATURE_OLD  0x28 // the shorter Extended BPB, without the volume label and system ID
+#define FAT32_FAT_ENTRY_SIZE 4
+#define FAT32_ENTRY_MASK     0x0FFFFFFF // the top 4 bits of a FAT32 entry are reserved
+#define FAT32_RESERVED_FIRST 0x0FFFFFF0
+#define FAT32_END_OF_CHAIN   0x0FFFFFF8
+
+#define FAT32_FS_INFO_LEAD_SIGNATURE   0x41615252
+#define FAT32_FS_INFO_STRUCT_SIGNATURE 0x61417272
+#define FAT32_FS_INFO_UNKNOWN          0xFFFFFFFF // free count or next free cluster not known
+
+typedef unsigned int FAT_TYPE;
+#define FAT_TYPE_16 0
+#define FAT_TYPE_32 1
+
+typedef unsigned int FAT_ITEM_TYPE;
+#define FAT_ITEM_TYPE_FILE      0
+#define FAT_ITEM_TYPE_DIRECTORY 1
+
+// FAT directory entry attributes
+#define FAT16_ATTR_READ_ONLY    0x01
+#define FAT16_ATTR_HIDDEN       0x02
+#define FAT16_ATTR_SYSTEM       0x04
+#define FAT16_ATTR_VOLUME_ID    0x08
+#define FAT16_ATTR_SUBDIRECTORY 0x10
+#define FAT16_ATTR_ARCHIVE      0x20
+#define FAT16_ATTR_DEVICE       0x40
+#define FAT16_ATTR_RESERVED     0x80
+
+#define FAT16_FILE_NAME_LENGTH 8
+#define FAT16_FILE_EXT_LENGTH  3
+
+#define FAT16_ITEM_END     0x00 // first byte of the name: no more items in the directory
+#define FAT16_ITEM_DELETED 0xE5 // first byte of the name: the item is free
+
+#define FAT16_DIRECTORY_CHUNK_SIZE 4096 // Directories are read this many bytes at a time
+#define FAT_ENTRY_WRITE_BATCH      128  // FAT entries converted to the disk format per write
+
+#define FAT16_LONG_NAME_ATTRIBUTES    0x0F // read-only, hidden, system and volume ID together mark a long name entry
+#define FAT16_LONG_NAME_ATTR_MASK     0x3F
+#define FAT16_LONG_NAME_LAST          0x40 // sequence number flag of the last part of a long name, stored first
+#define FAT16_LONG_NAME_SEQUENCE_MASK 0x1F
+#define FAT16_LONG_NAME_MAX_ENTRIES   20  // 20 entries of 13 characters hold the longest name
+#define FAT16_LONG_NAME_ENTRY_CHARS   13
+#define FAT16_LONG_NAME_LENGTH        256 // 255 characters and the terminator
+
+struct fat_header
+{
+    uint8_t jump[3];
+    uint8_t oem_id[8];
+    uint16_t bytes_per_sector;
+    uint8_t sectors_per_cluster;
+    uint16_t reserved_sectors;
+    uint8_t fat_copies;
+    uint16_t root_dir_entries;
+    uint16_t total_sectors;
+    uint8_t media_type;
+    uint16_t sectors_per_fat;
+    uint16_t sectors_per_track;
+    uint16_t heads;
+    uint32_t hidden_sectors;
+    uint32_t sectors_big;
+} __attribute__((packed));
+
+struct fat_header_extended
+{
+    uint8_t drive_number;
+    uint8_t win_nt_bit;
+    uint8_t signature;
+    uint32_t volume_id;
+    uint8_t volume_label[11];
+    uint8_t system_id[8];
+} __attribute__((packed));
+
+// The FAT32 Extended BPB. FAT32 has no fixed root directory, and its FAT size doesn't fit `sectors_per_fat`.
+struct fat32_header_extended
+{
+    uint32_t sectors_per_fat;
+    uint16_t flags;
+    uint16_t version;
+    uint32_t root_cluster;
+    uint16_t fs_info_sector;
+    uint16_t backup_boot_sector;
+    uint8_t reserved[12];
+    struct fat_header_extended extended;
+} __attribute__((packed));
+
+struct fat_header_universal
+{
+    struct fat_header primary;
+    union
+    {
+        struct fat_header_extended extended;
+        struct fat32_header_extended extended32;
+    };
+} __attribute__((packed));
+
+// The FAT32 FSInfo sector keeps a hint of the free cluster count and the next free cluster
+struct fat32_fs_info
+{
+    uint32_t lead_signature;
+    uint8_t reserved1[480];
+    uint32_t struct_signature;
+    uint32_t free_count;
+    uint32_t next_free;
+    uint8_t reserved2[12];
+    uint32_t trail_signature;
+} __attribute__((packed));
+
+struct fat_directory_item
+{
+    uint8_t file_name[FAT16_FILE_NAME_LENGTH];
+    uint8_t file_extension[FAT16_FILE_EXT_LENGTH];
+    uint8_t attributes;
+    uint8_t reserved;
+    uint8_t creation_time_ms;
+    uint16_t creation_time;
+    uint16_t creation_date;
+    uint16_t last_access_date;
+    uint16_t first_cluster_high;
+    uint16_t last_modification_time;
+    uint16_t last_modification_date;
+    uint16_t first_cluster_low;
+    uint32_t file_size;
+} __attribute__((packed));
+
+// A VFAT long name entry. A long name is split over up to 20 of these in front of the 8.3 entry of the item, last part
+// first. The UCS-2 characters of each part are split over three fields.
+struct fat_long_name_item
+{
+    uint8_t sequence;
+    uint16_t name1[5];
+    uint8_t attributes; // always FAT16_LONG_NAME_ATTRIBUTES
+    uint8_t type;
+    uint8_t checksum; // checksum of the 8.3 name of the item, to detect entries orphaned by a driver without VFAT
+    uint16_t name2[6];
+    uint16_t first_cluster_low;
+    uint16_t name3[2];
+} __attribute__((packed));
+
+// What a loaded directory knows about an item besides its directory entry
+struct fat_directory_item_info
+{
+    uint64_t position; // byte position of the directory entry on the disk, to write the entry back
+    int long_name;     // offset of the VFAT long name in `long_names`, or -1
+};
+
+struct fat_directory
+{
+    struct fat_directory_item* items;
+    struct fat_directory_item_info* infos;
+    uint32_t count;
+    // The long names of the items, decoded once when the directory is loaded. Null-terminated strings back to back.
+    char* long_names;
+    uint32_t long_names_size;
+    uint32_t sector_position;
+    uint32_t last_sector_position;
+
+    // Hash index over the item names. Every item has two nodes: `i` for its 8.3 name and `count + i` for its long
+    // name. `hash_heads[bucket]` is the first node of the bucket, and `hash_next[node]` is the node after it in its
+    // bucket. -1 ends a bucket. Both are 0 if the index couldn't be allocated.
+    int* hash_heads;
+    int* hash_next;
+    uint32_t hash_bucket_count; // a power of 2
+};
+
+struct fat_item
+{
+    FAT_ITEM_TYPE type;
+    union
+    {
+        struct fat_directory* directory;
+        struct fat_directory_item* item;
+    };
+};
+
+struct fat_private_data
+{
+    struct fat_header_universal header;
+    struct fat_directory root_directory;
+
+    // FAT16 and FAT32 differ in the width of the FAT entries, and in where the root directory is
+    FAT_TYPE type;
+    uint32_t sectors_per_fat;
+    uint32_t data_sector;  // first sector of cluster 2
+    uint32_t root_cluster; // first cluster of the FAT32 root directory. 0 on FAT16, where the root is a fixed area.
+    uint32_t fs_info_sector; // 0 if the disk has no FSInfo sector
+
+    struct disk_stream* data_stream; // for data clusters
+    struct disk_stream* fat_stream;  // for file allocation table
+    struct disk_stream* dir_stream;  // for directory entries
+
+    // In-memory copy of the first FAT. Following a cluster chain is array indexing instead of a disk read per hop.
+    // FAT16 entries are widened to 32 bits when the FAT is loaded, and their special values to the FAT32 ones.
+    uint32_t* fat_table;
+    uint32_t fat_entry_count;
+    // The FAT can have more entries than the disk has clusters. Clusters 2 to `cluster_limit - 1` exist.
+    uint32_t cluster_limit;
+
+    // One bit per cluster, set if the cluster is free. Built at mount and kept in sync with `fat_table`, so allocation
+    // skips 32 used clusters at a time instead of reading FAT entries.
+    uint32_t* free_bitmap;
+    uint32_t free_cluster_count;
+    // Next-fit: the search for free clusters starts where the last allocation ended
+    uint32_t next_free_cluster;
+
+    // The files open on the disk, so an open file isn't unlinked from under its descriptors
+    struct fat_file_descriptor* open_files;
+};
+
+// What the dentry cache keeps for a FAT item
+struct fat_dentry_data
+{
+    struct fat_directory_item item;
+    uint64_t position; // byte position of the directory entry on the disk
+} __attribute__((packed));
+
+// Where a path leads: the item at the end of the path, and the directory that holds it
+struct fat_path_lookup
+{
+    bool found;
+    struct fat_directory_item item;
+    uint64_t position; // byte position of the directory entry of `item` on the disk
+    uint32_t id;       // dentry ID of `item`
+
+    bool parent_is_root;
+    struct fat_directory_item parent; // only if `parent_is_root` is false
+    uint32_t parent_id;
+    const char* name; // the last part of the path
+};
+
+// A run of clusters that are next to each other on the disk
+struct fat_extent
+{
+    uint32_t first_cluster;
+    uint32_t cluster_count;
+    // Index of `first_cluster` in the file, i.e., the extent starts at byte `file_cluster * cluster_size`
+    uint32_t file_cluster;
+};
+
+// The cluster chain of a file, resolved once and stored as extents. Files are usually contiguous, so this is a handful
+// of entries even for large files.
+struct fat_cluster_chain
+{
+    struct fat_extent* extents;
+    uint32_t count;
+    uint32_t capacity;
+    // The extent the last lookup landed in. Sequential reads keep hitting it (or the next one).
+    uint32_t hint;
+};
+
+// A long name being put together from its entries while a directory is read
+struct fat_long_name_parser
+{
+    uint16_t characters[FAT16_LONG_NAME_MAX_ENTRIES * FAT16_LONG_NAME_ENTRY_CHARS];
+    uint8_t checksum;
+    // Sequence number of the entry expected next. The parts come in reverse, so this counts down to 0, when the name
+    // is complete.
+    uint8_t next_sequence;
+    bool active;
+};
+
+// An open directory, read a chunk at a time as its items are listed
+struct fat_directory_stream
+{
+    // The cluster chain of the directory. It's empty for the FAT16 root directory, which is a fixed area at `position`.
+    struct fat_cluster_chain chain;
+    bool fixed_root;
+    uint64_t position;
+    uint32_t size;
+
+    // Offset of the next entry in the directory
+    uint32_t offset;
+
+    // The part of the directory in `chunk`
+    uint32_t chunk_offset;
+    uint32_t chunk_size;
+    struct fat_directory_item chunk[FAT16_DIRECTORY_CHUNK_SIZE / sizeof(struct fat_directory_item)];
+
+    struct fat_long_name_parser parser;
+};
+
+// Represents a file descriptor for an item in the FAT file system
+struct fat_file_descriptor
+{
+    struct fat_item* item;
+    uint32_t position;
+    struct fat_cluster_chain chain;
+    FILE_MODE mode;
+
+    // Where the directory entry of the item is, to write it back when the file changes
+    uint64_t entry_position;
+    // The dentries of the item (8.3 and long name), to drop them when the directory entry changes
+    uint32_t parent_id;
+    char long_name[FAT16_LONG_NAME_LENGTH];
+
+    // Links in the open file list of the disk
+    struct fat_private_data* fs_data;
+    struct fat_file_descriptor* previous;
+    struct fat_file_descriptor* next;
+};
+
+status_t fat16_resolve(struct disk* disk);
+status_t fat32_resolve(struct disk* disk);
+void* fat_open(struct disk* disk, struct path_part* path, FILE_MODE mode);
+size_t fat_read(struct disk* disk, void* fd, uint32_t size, uint32_t count, char* out);
+size_t fat_preadv(struct disk* disk, void* fd, struct file_io_vector* vectors, uint32_t count, uint32_t offset);
+status_t fat_write(struct disk* disk, void* fd, size_t size, size_t count, const char* in, size_t* out_count);
+status_t fat_truncate(struct disk* disk, void* fd, uint32_t size);
+status_t fat_unlink(struct disk* disk, struct path_part* path);
+status_t fat_seek(void* private_data, uint32_t offset, FILE_SEEK_MODE mode);
+status_t fat_stat(void* private_data, struct file_stat* stat);
+status_t fat_close(void* private_data);
+void* fat_opendir(struct disk* disk, struct path_part* path);
+status_t fat_readdir(struct disk* disk, void* private_data, struct file_dirent* entry);
+status_t fat_closedir(void* private_data);
+
+struct fat_cluster_chain;
+static status_t fat_load_directory_items(
+  struct disk* disk,
+  struct fat_cluster_chain* chain,
+  uint64_t position,
+  uint32_t size,
+  struct fat_directory* directory
+);
+static void fat_build_directory_index(struct fat_directory* directory);
+static uint32_t fat_cluster_to_sector(struct fat_private_data* private_data, uint32_t cluster);
+static void fat_free_cluster_chain(struct fat_cluster_chain* chain);
+static status_t fat_load_cluster_chain(struct disk* disk, uint32_t first_cluster, struct fat_cluster_chain* chain);
+static uint32_t fat_get_chain_length(struct fat_cluster_chain* chain);
+
+struct file_system fat16_fs = {
+    .name = "FAT16",
+    .resolve = fat16_resolve,
+    .open = fat_open,
+    .read = fat_read,
+    .preadv = fat_preadv,
+    .write = fat_write,
+    .truncate = fat_truncate,
+    .unlink = fat_unlink,
+    .seek = fat_seek,
+    .stat = fat_stat,
+    .close = fat_close,
+    .opendir = fat_opendir,
+    .readdir = fat_readdir,
+    .closedir = fat_closedir,
+};
+
+// FAT32 shares everything with FAT16 but finding the disk layout, so it gets the same functions
+struct file_system fat32_fs = {
+    .name = "FAT32",
+    .resolve = fat32_resolve,
+    .open = fat_open,
+    .read = fat_read,
+    .preadv = fat_preadv,
+    .write = fat_write,
+    .truncate = fat_truncate,
+    .unlink = fat_unlink,
+    .seek = fat_seek,
+    .stat = fat_stat,
+    .close = fat_close,
+    .opendir = fat_opendir,
+    .readdir = fat_readdir,
+    .closedir = fat_closedir,
+};
+
+struct file_system*
+fat16_initialize()
+{
+    return &fat16_fs;
+}
+
+struct file_system*
+fat32_initialize()
+{
+    return &fat32_fs;
+}
+
+static void
+fat_private_initialize(struct disk* disk, struct fat_private_data* private_data, FAT_TYPE type)
+{
+    memset(private_data, 0, sizeof(struct fat_private_data));
+
+    private_data->type = type;
+    private_data->data_stream = disk_stream_open(disk->id);
+    private_data->fat_stream = disk_stream_open(disk->id);
+    private_data->dir_stream = disk_stream_open(disk->id);
+
+    disk->private_data = private_data;
+    disk->fs = type == FAT_TYPE_32 ? &fat32_fs : &fat16_fs;
+}
+
+status_t
+fat_get_root_directory(struct disk* disk, struct fat_private_data* private_data, struct fat_directory* directory)
+{
+    struct fat_header* primary = &private_data->header.primary;
+
+    if (private_data->root_cluster) {
+        // The FAT32 root directory is a cluster chain, like any subdirectory
+        struct fat_cluster_chain chain;
+        status_t result = fat_load_cluster_chain(disk, private_data->root_cluster, &chain);
+        if (result != ALL_OK) {
+            return result;
+        }
+
+        directory->sector_position = fat_cluster_to_sector(private_data, private_data->root_cluster);
+        directory->last_sector_position = directory->sector_position;
+        uint32_t cluster_size = primary->sectors_per_cluster * disk->sector_size;
+        result = fat_load_directory_items(disk, &chain, 0, fat_get_chain_length(&chain) * cluster_size, directory);
+        fat_free_cluster_chain(&chain);
+        return result;
+    }
+
+    // calculate the root directory sector
+    // Note that `root_dir_entries` is the max entries this root directory can hold, not the actual
+    // items in the root directory.
+    uint32_t root_dir_size = primary->root_dir_entries * sizeof(struct fat_directory_item);
+    uint32_t root_dir_sectors = (root_dir_size + (primary->bytes_per_sector - 1)) /
+                                primary->bytes_per_sector; // add `bytes_per_sector - 1` to round up
+    uint32_t root_dir_sector_pos = (primary->fat_copies * private_data->sectors_per_fat) + primary->reserved_sectors;
+
+    directory->sector_position = root_dir_sector_pos;
+    directory->last_sector_position = root_dir_sector_pos + root_dir_sectors;
+
+    // The root directory isn't made of clusters. It's a fixed area right after the FATs.
+    return fat_load_directory_items(disk, 0, root_dir_sector_pos * primary->bytes_per_sector, root_dir_size, directory);
+}
+
+/// @brief Checks that the header is a FAT16 or FAT32 header, as asked for, and works out the disk layout from it.
+/// @return ALL_OK, or EFSNOTSUPPORTED if the disk has another file system
+static status_t
+fat_read_layout(struct fat_private_data* private_data)
+{
+    struct fat_header* primary = &private_data->header.primary;
+
+    if (primary->bytes_per_sector == 0 || primary->sectors_per_cluster == 0) {
+        return ERROR(EFSNOTSUPPORTED);
+    }
+
+    // FAT32 is the only one with a 0 `sectors_per_fat` in the common header
+    if (private_data->type == FAT_TYPE_16) {
+        if (primary->sectors_per_fat == 0 || private_data->header.extended.signature != FAT16_SIGNATURE) {
+            return ERROR(EFSNOTSUPPORTED);
+        }
+        private_data->sectors_per_fat = primary->sectors_per_fat;
+    } else {
+        struct fat32_header_extended* extended32 = &private_data->header.extended32;
+        uint8_t signature = extended32->extended.signature;
+        if (primary->sectors_per_fat != 0 || (signature != FAT16_SIGNATURE && signature != FAT32_SIGNATURE_OLD)) {
+            return ERROR(EFSNOTSUPPORTED);
+        }
+        private_data->sectors_per_fat = extended32->sectors_per_fat;
+        private_data->root_cluster = extended32->root_cluster;
+        private_data->fs_info_sector = extended32->fs_info_sector;
+    }
+
+    uint32_t root_dir_size = primary->root_dir_entries * sizeof(struct fat_directory_item);
+    uint32_t root_dir_sectors = (root_dir_size + primary->bytes_per_sector - 1) / primary->bytes_per_sector;
+    private_data->data_sector =
+      primary->reserved_sectors + primary->fat_copies * private_data->sectors_per_fat + root_dir_sectors;
+    return ALL_OK;
+}
+
+/// @brief Reads the first FAT into memory. A FAT16 FAT is at most 65536 entries (128KB), and a FAT32 FAT is 4 bytes per
+/// cluster. FAT16 entries are widened to the FAT32 format, so the rest of the driver handles one format.
+static status_t
+fat_load_fat_table(struct disk_stream* stream, struct fat_private_data* private_data)
+{
+    struct fat_header* primary = &private_data->header.primary;
+    uint32_t fat_size = private_data->sectors_per_fat * primary->bytes_per_sector;
+    uint32_t entry_size = private_data->type == FAT_TYPE_32 ? FAT32_FAT_ENTRY_SIZE : FAT16_FAT_ENTRY_SIZE;
+    uint32_t entry_count = fat_size / entry_size;
+
+    private_data->fat_table = (uint32_t*)kzalloc(entry_count * sizeof(uint32_t));
+    if (!private_data->fat_table) {
+        return ERROR(ENOMEM);
+    }
+
+    status_t result = disk_stream_seek(stream, primary->reserved_sectors * primary->bytes_per_sector);
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    if (private_data->type == FAT_TYPE_32) {
+        result = disk_stream_read(stream, (char*)private_data->fat_table, fat_size);
+        if (result != ALL_OK) {
+            return result;
+        }
+        for (uint32_t i = 0; i < entry_count; i++) {
+            private_data->fat_table[i] &= FAT32_ENTRY_MASK;
+        }
+    } else {
+        // The 16-bit FAT goes to the upper half of the table, and is widened from the first entry up
+        uint16_t* fat16_table = (uint16_t*)(private_data->fat_table + entry_count / 2);
+        result = disk_stream_read(stream, (char*)fat16_table, fat_size);
+        if (result != ALL_OK) {
+            return result;
+        }
+        for (uint32_t i = 0; i < entry_count; i++) {
+            uint32_t entry = fat16_table[i];
+            if (entry >= FAT16_RESERVED_FIRST) {
+                entry += FAT32_RESERVED_FIRST - FAT16_RESERVED_FIRST;
+            }
+            private_data->fat_table[i] = entry;
+        }
+    }
+
+    private_data->fat_entry_count = entry_count;
+    return ALL_OK;
+}
+
+// The data area runs from `data_sector` to the end of the disk
+static uint32_t
+fat_get_cluster_limit(struct fat_private_data* private_data)
+{
+    struct fat_header* primary = &private_data->header.primary;
+    uint32_t total_sectors = primary->total_sectors ? primary->total_sectors : primary->sectors_big;
+    uint32_t data_sector = private_data->data_sector;
+    if (total_sectors <= data_sector) {
+        return 2;
+    }
+
+    uint32_t limit = (total_sectors - data_sector) / primary->sectors_per_cluster + 2;
+    return limit < private_data->fat_entry_count ? limit : private_data->fat_entry_count;
+}
+
+static bool
+fat_is_cluster_free(struct fat_private_data* private_data, uint32_t cluster)
+{
+    return private_data->free_bitmap[cluster / 32] & (1U << (cluster % 32));
+}
+
+// Updates the entry of `cluster` in the in-memory FAT, and the free-cluster bitmap with it
+static void
+fat_set_fat_table_entry(struct fat_private_data* private_data, uint32_t cluster, uint32_t value)
+{
+    bool was_free = fat_is_cluster_free(private_data, cluster);
+    bool is_free = value == FAT_UNUSED_CLUSTER;
+
+    private_data->fat_table[cluster] = value;
+    if (is_free && !was_free) {
+        private_data->free_bitmap[cluster / 32] |= 1U << (cluster % 32);
+        private_data->free_cluster_count++;
+    } else if (!is_free && was_free) {
+        private_data->free_bitmap[cluster / 32] &= ~(1U << (cluster % 32));
+        private_data->free_cluster_count--;
+    }
+}
+
+// Scans the in-memory FAT once for free clusters. Allocation uses the bitmap from then on.
+static status_t
+fat_build_free_bitmap(struct fat_private_data* private_data)
+{
+    uint32_t words = (private_data->cluster_limit + 31) / 32;
+    private_data->free_bitmap = kzalloc(words * sizeof(uint32_t));
+    if (!private_data->free_bitmap) {
+        return ERROR(ENOMEM);
+    }
+
+    private_data->free_cluster_count = 0;
+    for (uint32_t cluster = 2; cluster < private_data->cluster_limit; cluster++) {
+        if (private_data->fat_table[cluster] == FAT_UNUSED_CLUSTER) {
+            private_data->free_bitmap[cluster / 32] |= 1U << (cluster % 32);
+            private_data->free_cluster_count++;
+        }
+    }
+    private_data->next_free_cluster = 2;
+    return ALL_OK;
+}
+
+/// @brief Reads the FAT32 FSInfo sector. Its next free cluster hint is where the next-fit search starts, so a freshly
+/// mounted disk keeps allocating where it left off. The free count is not trusted: the bitmap scan counts it exactly.
+static void
+fat32_read_fs_info(struct disk_stream* stream, struct fat_private_data* private_data)
+{
+    struct fat32_fs_info fs_info;
+    uint32_t position = private_data->fs_info_sector * private_data->header.primary.bytes_per_sector;
+
+    if (private_data->fs_info_sector == 0 || disk_stream_seek(stream, position) != ALL_OK ||
+        disk_stream_read(stream, (char*)&fs_info, sizeof(fs_info)) != ALL_OK ||
+        fs_info.lead_signature != FAT32_FS_INFO_LEAD_SIGNATURE ||
+        fs_info.struct_signature != FAT32_FS_INFO_STRUCT_SIGNATURE) {
+        // no usable FSInfo, so don't write it back either
+        private_data->fs_info_sector = 0;
+        return;
+    }
+
+    if (fs_info.next_free >= 2 && fs_info.next_free < private_data->cluster_limit) {
+        private_data->next_free_cluster = fs_info.next_free;
+    }
+}
+
+// Writes the free cluster count and the next-fit hint back to the FSInfo sector, after clusters are allocated or freed
+static status_t
+fat32_write_fs_info(struct disk* disk)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    if (private_data->type != FAT_TYPE_32 || private_data->fs_info_sector == 0) {
+        return ALL_OK;
+    }
+
+    uint32_t hint[2] = { private_data->free_cluster_count, private_data->next_free_cluster };
+    uint32_t position = private_data->fs_info_sector * private_data->header.primary.bytes_per_sector;
+    status_t result = disk_stream_seek(private_data->fat_stream, position + offsetof(struct fat32_fs_info, free_count));
+    if (result != ALL_OK) {
+        return result;
+    }
+    return disk_stream_write(private_data->fat_stream, (const char*)hint, sizeof(hint));
+}
+
+static status_t
+fat_resolve_type(struct disk* disk, FAT_TYPE type)
+{
+    status_t result = ALL_OK;
+    struct disk_stream* stream = 0;
+
+    struct fat_private_data* private_data = (struct fat_private_data*)kzalloc(sizeof(struct fat_private_data));
+    if (!private_data) {
+        return ERROR(ENOMEM);
+    }
+    fat_private_initialize(disk, private_data, type);
+
+    if (private_data->data_stream == 0 || private_data->fat_stream == 0 || private_data->dir_stream == 0) {
+        result = ERROR(ENOMEM);
+        goto out;
+    }
+
+    // We'll leave the streams in `private_data` untouched, and use new streams for reading the
+    // header and root directory.
+    stream = disk_stream_open(disk->id);
+    if (!stream) {
+        result = ERROR(ENOMEM);
+        goto out;
+    }
+
+    result = disk_stream_read(stream, (char*)&private_data->header, sizeof(struct fat_header_universal));
+    if (result != ALL_OK) {
+        goto out;
+    }
+
+    // check if this is a FAT16 (or FAT32) file system
+    result = fat_read_layout(private_data);
+    if (result != ALL_OK) {
+        goto out;
+    }
+
+    result = fat_load_fat_table(stream, private_data);
+    if (result != ALL_OK) {
+        goto out;
+    }
+
+    private_data->cluster_limit = fat_get_cluster_limit(private_data);
+    result = fat_build_free_bitmap(private_data);
+    if (result != ALL_OK) {
+        goto out;
+    }
+    if (type == FAT_TYPE_32) {
+        fat32_read_fs_info(stream, private_data);
+    }
+
+    result = fat_get_root_directory(disk, private_data, &private_data->root_directory);
+    if (result != ALL_OK) {
+        goto out;
+    }
+
+out:
+    if (result != ALL_OK) {
+        if (private_data->fat_table) {
+            kfree(private_data->fat_table);
+        }
+        if (private_data->free_bitmap) {
+            kfree(private_data->free_bitmap);
+        }
+        if (private_data->data_stream) {
+            disk_stream_close(private_data->data_stream);
+        }
+        if (private_data->fat_stream) {
+            disk_stream_close(private_data->fat_stream);
+        }
+        if (private_data->dir_stream) {
+            disk_stream_close(private_data->dir_stream);
+        }
+        kfree(private_data);
+        disk->private_data = 0;
+        disk->fs = 0;
+    }
+    if (stream) {
+        disk_stream_close(stream);
+    }
+    return result;
+}
+
+status_t
+fat16_resolve(struct disk* disk)
+{
+    return fat_resolve_type(disk, FAT_TYPE_16);
+}
+
+status_t
+fat32_resolve(struct disk* disk)
+{
+    return fat_resolve_type(disk, FAT_TYPE_32);
+}
+
+static void
+fat_free_directory_items(struct fat_directory* directory)
+{
+    if (directory->items) {
+        kfree(directory->items);
+    }
+    if (directory->infos) {
+        kfree(directory->infos);
+    }
+    if (directory->long_names) {
+        kfree(directory->long_names);
+    }
+    if (directory->hash_heads) {
+        kfree(directory->hash_heads);
+    }
+    directory->items = 0;
+    directory->infos = 0;
+    directory->long_names = 0;
+    directory->long_names_size = 0;
+    directory->hash_heads = 0;
+    directory->hash_next = 0;
+    directory->hash_bucket_count = 0;
+    directory->count = 0;
+}
+
+void
+fat_free_directory(struct fat_directory* directory)
+{
+    if (!directory) {
+        return;
+    }
+    fat_free_directory_items(directory);
+    kfree(directory);
+}
+
+void
+fat_free_item(struct fat_item* item)
+{
+    if (!item) {
+        return;
+    }
+    if (item->type == FAT_ITEM_TYPE_DIRECTORY) {
+        fat_free_directory(item->directory);
+    } else if (item->type == FAT_ITEM_TYPE_FILE) {
+        kfree(item->item);
+    }
+    kfree(item);
+}
+
+// replace the first white space with null terminator
+void
+fat_to_proper_string(char** out, const char* in, size_t length)
+{
+    while (*in != ' ' && *in != 0 && length > 0) {
+        **out = *in;
+        (*out)++;
+        in++;
+        length--;
+    }
+    **out = 0;
+}
+
+// join the file name and extension strings with "." in between, removing the white spaces
+void
+fat_get_full_relative_filename(struct fat_directory_item* item, char* buffer, size_t buffer_size)
+{
+    memset(buffer, 0, buffer_size);
+    char* out = buffer;
+    fat_to_proper_string(&out, (const char*)item->file_name, sizeof(item->file_name));
+    if (item->file_extension[0] != ' ' && item->file_extension[0] != 0) {
+        *out++ = '.';
+        fat_to_proper_string(&out, (const char*)item->file_extension, sizeof(item->file_extension));
+    }
+}
+
+static uint32_t
+fat_get_first_cluster(struct fat_directory_item* item)
+{
+    return (item->first_cluster_high << 16) | item->first_cluster_low;
+}
+
+static uint32_t
+fat_cluster_to_sector(struct fat_private_data* private_data, uint32_t cluster)
+{
+    return ((cluster - 2) * private_data->header.primary.sectors_per_cluster) +
+           private_data->data_sector;
+}
+
+static uint32_t
+fat_get_fat_entry(struct disk* disk, int cluster)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    if (cluster < 0 || (uint32_t)cluster >= private_data->fat_entry_count) {
+        // same as a corrupted entry
+        return FAT_UNUSED_CLUSTER;
+    }
+    return private_data->fat_table[cluster];
+}
+
+static void
+fat_free_cluster_chain(struct fat_cluster_chain* chain)
+{
+    if (chain->extents) {
+        kfree(chain->extents);
+    }
+    memset(chain, 0, sizeof(struct fat_cluster_chain));
+}
+
+// Appends `count` clusters starting at `cluster` to the chain, merging them into the last extent if they follow it
+static status_t
+fat_append_clusters(struct fat_cluster_chain* chain, uint32_t cluster, uint32_t count, uint32_t file_cluster)
+{
+    if (chain->count > 0) {
+        struct fat_extent* last = &chain->extents[chain->count - 1];
+        if (last->first_cluster + last->cluster_count == cluster) {
+            last->cluster_count += count;
+            return ALL_OK;
+        }
+    }
+
+    if (chain->count == chain->capacity) {
+        // Every heap allocation is at least a 4KB block, so grow a block at a time
+        uint32_t capacity = chain->capacity + HEAP_BLOCK_SIZE_BYTES / sizeof(struct fat_extent);
+        struct fat_extent* extents = kzalloc(capacity * sizeof(struct fat_extent));
+        if (!extents) {
+            return ERROR(ENOMEM);
+        }
+        if (chain->extents) {
+            memcpy(extents, chain->extents, chain->count * sizeof(struct fat_extent));
+            kfree(chain->extents);
+        }
+        chain->extents = extents;
+        chain->capacity = capacity;
+    }
+
+    struct fat_extent* extent = &chain->extents[chain->count++];
+    extent->first_cluster = cluster;
+    extent->cluster_count = count;
+    extent->file_cluster = file_cluster;
+    return ALL_OK;
+}
+
+/// @brief Follows the cluster chain that starts at `first_cluster` in the in-memory FAT, and stores it as extents.
+/// @param disk The disk the file is on
+/// @param first_cluster The first cluster of the file. Empty files have no cluster (0).
+/// @param chain The chain to fill in
+/// @return ALL_OK, or EIO if the chain is corrupted
+static status_t
+fat_load_cluster_chain(struct disk* disk, uint32_t first_cluster, struct fat_cluster_chain* chain)
+{
+    status_t result = ALL_OK;
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+
+    memset(chain, 0, sizeof(struct fat_cluster_chain));
+    if (first_cluster == FAT_UNUSED_CLUSTER) {
+        goto out;
+    }
+
+    uint32_t cluster = first_cluster;
+    for (uint32_t file_cluster = 0;; file_cluster++) {
+        // a chain longer than the FAT must loop
+        if (cluster < 2 || cluster >= private_data->cluster_limit || file_cluster >= private_data->cluster_limit) {
+            result = ERROR(EIO);
+            goto out;
+        }
+
+        result = fat_append_clusters(chain, cluster, 1, file_cluster);
+        if (result != ALL_OK) {
+            goto out;
+        }
+
+        uint32_t entry = fat_get_fat_entry(disk, cluster);
+        if (entry >= FAT32_END_OF_CHAIN) {
+            break;
+        }
+
+        // bad, reserved or free clusters can't be part of a chain
+        if (entry >= FAT32_RESERVED_FIRST || entry == FAT_UNUSED_CLUSTER) {
+            result = ERROR(EIO);
+            goto out;
+        }
+        cluster = entry;
+    }
+
+out:
+    if (result != ALL_OK) {
+        fat_free_cluster_chain(chain);
+    }
+    return result;
+}
+
+// Finds the extent that holds the `file_cluster`th cluster of the file
+static struct fat_extent*
+fat_get_extent_for_cluster(struct fat_cluster_chain* chain, uint32_t file_cluster)
+{
+    // Sequential reads stay in the extent of the last lookup, or move on to the next one
+    for (uint32_t i = chain->hint; i < chain->count && i <= chain->hint + 1; i++) {
+        struct fat_extent* extent = &chain->extents[i];
+        if (file_cluster >= extent->file_cluster && file_cluster < extent->file_cluster + extent->cluster_count) {
+            chain->hint = i;
+            return extent;
+        }
+    }
+
+    // The extents are sorted by `file_cluster`, so a random access is a binary search
+    uint32_t low = 0;
+    uint32_t high = chain->count;
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+        struct fat_extent* extent = &chain->extents[middle];
+        if (file_cluster < extent->file_cluster) {
+            high = middle;
+        } else if (file_cluster >= extent->file_cluster + extent->cluster_count) {
+            low = middle + 1;
+        } else {
+            chain->hint = middle;
+            return extent;
+        }
+    }
+
+    // past the end of the chain
+    return 0;
+}
+
+/// @brief Maps `offset` in the file described by `chain` to a byte position on the disk.
+/// @param out_position Receives the byte position on the disk
+/// @param out_contiguous Receives how many bytes from `offset` on are contiguous on the disk (to the end of the extent)
+/// @return ALL_OK, or EIO if `offset` is past the end of the chain
+static status_t
+fat_get_disk_position(
+  struct disk* disk,
+  struct fat_cluster_chain* chain,
+  uint32_t offset,
+  uint64_t* out_position,
+  uint32_t* out_contiguous
+)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    uint32_t cluster_size = private_data->header.primary.sectors_per_cluster * disk->sector_size;
+
+    uint32_t file_cluster = offset / cluster_size;
+    struct fat_extent* extent = fat_get_extent_for_cluster(chain, file_cluster);
+    if (!extent) {
+        return ERROR(EIO);
+    }
+
+    uint32_t cluster = extent->first_cluster + (file_cluster - extent->file_cluster);
+    uint64_t sector = fat_cluster_to_sector(private_data, cluster);
+    *out_position = sector * disk->sector_size + offset % cluster_size;
+    *out_contiguous = (extent->file_cluster + extent->cluster_count) * cluster_size - offset;
+    return ALL_OK;
+}
+
+// Starts reading the small pieces of the range that fall in the extents after the first one into the buffer cache. The
+// reads of a fragmented range (i.e., a directory chunk over several clusters) then reach the disk scheduler together
+// instead of one after the other. Large pieces aren't prefetched: they bypass the cache when they are read.
+static void
+fat_prefetch_extents(struct disk* disk, struct fat_cluster_chain* chain, uint32_t offset, uint32_t length)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    uint32_t max_prefetch = DISK_BUFFER_CACHE_MAX_FILL_SECTORS * disk->sector_size;
+    bool first = true;
+
+    while (length > 0) {
+        uint64_t position = 0;
+        uint32_t contiguous = 0;
+        if (fat_get_disk_position(disk, chain, offset, &position, &contiguous) != ALL_OK || contiguous == 0) {
+            return;
+        }
+        if (contiguous > length) {
+            contiguous = length;
+        }
+
+        if (!first && contiguous <= max_prefetch) {
+            disk_stream_prefetch(private_data->data_stream, position, contiguous);
+        }
+        first = false;
+
+        offset += contiguous;
+        length -= contiguous;
+    }
+}
+
+/// @brief Reads `length` bytes at `offset` of the file described by `chain` into `buffer`. Each extent is physically
+/// contiguous, so the part of the range that falls in an extent is read with one stream read, which reads the whole
+/// sectors straight into `buffer` with a single disk request. A contiguous file is read with one request. The small
+/// pieces in later extents are prefetched first (see `fat_prefetch_extents()`).
+static status_t
+fat_read_internal(struct disk* disk, struct fat_cluster_chain* chain, uint32_t offset, uint32_t length, void* buffer)
+{
+    status_t result = ALL_OK;
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    struct disk_stream* stream = private_data->data_stream;
+    char* out = (char*)buffer;
+
+    fat_prefetch_extents(disk, chain, offset, length);
+
+    while (length > 0) {
+        uint64_t position = 0;
+        uint32_t total_to_read = 0;
+        result = fat_get_disk_position(disk, chain, offset, &position, &total_to_read);
+        if (result != ALL_OK) {
+            goto out;
+        }
+
+        // read up to the end of the extent
+        if (total_to_read > length) {
+            total_to_read = length;
+        }
+
+        result = disk_stream_seek(stream, position);
+        if (result != ALL_OK) {
+            goto out;
+        }
+        result = disk_stream_read(stream, out, total_to_read);
+        if (result != ALL_OK) {
+            goto out;
+        }
+
+        offset += total_to_read;
+        out += total_to_read;
+        length -= total_to_read;
+    }
+
+out:
+    return result;
+}
+
+/// @brief Writes `length` bytes of `buffer` at `offset` of the file described by `chain`, one stream write per extent.
+/// The chain must already cover the range.
+/// @param out_written Receives the number of bytes written before an error, or `length`. Can be 0.
+static status_t
+fat_write_internal(
+  struct disk* disk,
+  struct fat_cluster_chain* chain,
+  uint32_t offset,
+  uint32_t length,
+  const void* buffer,
+  uint32_t* out_written
+)
+{
+    status_t result = ALL_OK;
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    struct disk_stream* stream = private_data->data_stream;
+    const char* in = (const char*)buffer;
+
+    if (out_written) {
+        *out_written = 0;
+    }
+
+    while (length > 0) {
+        uint64_t position = 0;
+        uint32_t total_to_write = 0;
+        result = fat_get_disk_position(disk, chain, offset, &position, &total_to_write);
+        if (result != ALL_OK) {
+            goto out;
+        }
+
+        // write up to the end of the extent
+        if (total_to_write > length) {
+            total_to_write = length;
+        }
+
+        result = disk_stream_seek(stream, position);
+        if (result != ALL_OK) {
+            goto out;
+        }
+        result = disk_stream_write(stream, in, total_to_write);
+        if (result != ALL_OK) {
+            goto out;
+        }
+
+        offset += total_to_write;
+        in += total_to_write;
+        length -= total_to_write;
+        if (out_written) {
+            *out_written += total_to_write;
+        }
+    }
+
+out:
+    return result;
+}
+
+/// @brief Writes the in-memory FAT entries of `count` clusters from `first` to every copy of the FAT on the disk. The
+/// entries are converted back to the disk format a batch at a time, with one stream write per batch and FAT copy. The
+/// reserved top bits of FAT32 entries are written as 0.
+static status_t
+fat_write_fat_entries(struct disk* disk, uint32_t first, uint32_t count)
+{
+    status_t result = ALL_OK;
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    struct fat_header* primary = &private_data->header.primary;
+    uint32_t entry_size = private_data->type == FAT_TYPE_32 ? FAT32_FAT_ENTRY_SIZE : FAT16_FAT_ENTRY_SIZE;
+    uint32_t batch[FAT_ENTRY_WRITE_BATCH];
+    uint32_t batch_count = 0;
+
+    for (uint32_t done = 0; done < count && result == ALL_OK; done += batch_count) {
+        uint32_t* entries = &private_data->fat_table[first + done];
+        batch_count = count - done < FAT_ENTRY_WRITE_BATCH ? count - done : FAT_ENTRY_WRITE_BATCH;
+        if (private_data->type == FAT_TYPE_32) {
+            memcpy(batch, entries, batch_count * FAT32_FAT_ENTRY_SIZE);
+        } else {
+            uint16_t* narrow = (uint16_t*)batch;
+            for (uint32_t i = 0; i < batch_count; i++) {
+                uint32_t entry = entries[i];
+                narrow[i] = entry >= FAT32_RESERVED_FIRST ? entry - FAT32_RESERVED_FIRST + FAT16_RESERVED_FIRST : entry;
+            }
+        }
+
+        for (uint32_t i = 0; i < primary->fat_copies; i++) {
+            uint32_t fat_position = (primary->reserved_sectors + i * private_data->sectors_per_fat) *
+                                    primary->bytes_per_sector;
+            result = disk_stream_seek(private_data->fat_stream, fat_position + (first + done) * entry_size);
+            if (result != ALL_OK) {
+                break;
+            }
+            result = disk_stream_write(private_data->fat_stream, (const char*)batch, batch_count * entry_size);
+            if (result != ALL_OK) {
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+// Sets the FAT entry of `cluster` in the in-memory FAT and in every copy of the FAT on the disk
+static status_t
+fat_set_fat_entry(struct disk* disk, uint32_t cluster, uint32_t value)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    if (cluster < 2 || cluster >= private_data->cluster_limit) {
+        return ERROR(EINVARG);
+    }
+
+    fat_set_fat_table_entry(private_data, cluster, value);
+    return fat_write_fat_entries(disk, cluster, 1);
+}
+
+// Finds the first free cluster at or after `cluster`, skipping 32 used clusters at a time. 0 if there is none.
+static uint32_t
+fat_find_free_cluster(struct fat_private_data* private_data, uint32_t cluster)
+{
+    while (cluster < private_data->cluster_limit) {
+        uint32_t word = private_data->free_bitmap[cluster / 32] >> (cluster % 32);
+        if (word == 0) {
+            cluster = (cluster / 32 + 1) * 32;
+            continue;
+        }
+        while (!(word & 1)) {
+            word >>= 1;
+            cluster++;
+        }
+        return cluster < private_data->cluster_limit ? cluster : 0;
+    }
+    return 0;
+}
+
+// Gives back a run of clusters that was just allocated, because linking it to a file failed. The in-memory FAT and
+// the bitmap are always restored. Writing the FATs is best effort: the disk already failed once, and the run is free
+// in memory either way, so nothing leaks while the disk stays mounted.
+static void
+fat_release_clusters(struct disk* disk, uint32_t first, uint32_t count)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    for (uint32_t i = 0; i < count; i++) {
+        fat_set_fat_table_entry(private_data, first + i, FAT_UNUSED_CLUSTER);
+    }
+    fat_write_fat_entries(disk, first, count);
+}
+
+/// @brief Allocates a run of up to `wanted` free clusters that are next to each other on the disk. The run starts at
+/// `goal` if that cluster is free, so a growing file stays contiguous. Otherwise the search goes on from where the
+/// last allocation ended (next-fit), and wraps around once.
+/// @param disk The disk
+/// @param goal The cluster to try first, i.e., the one after the last cluster of the file. 0 for none.
+/// @param wanted The number of clusters wanted
+/// @param out_first Receives the first cluster of the run
+/// @param out_count Receives the length of the run, between 1 and `wanted`
+/// @return ALL_OK, or ENOSPACE if there is no free cluster. Nothing stays allocated when it fails.
+static status_t
+fat_allocate_clusters(struct disk* disk, uint32_t goal, uint32_t wanted, uint32_t* out_first, uint32_t* out_count)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+
+    uint32_t first = 0;
+    if (goal >= 2 && goal < private_data->cluster_limit && fat_is_cluster_free(private_data, goal)) {
+        first = goal;
+    } else {
+        first = fat_find_free_cluster(private_data, private_data->next_free_cluster);
+        if (first == 0) {
+            first = fat_find_free_cluster(private_data, 2);
+        }
+    }
+    if (first == 0) {
+        return ERROR(ENOSPACE);
+    }
+
+    uint32_t count = 1;
+    while (count < wanted && first + count < private_data->cluster_limit &&
+           fat_is_cluster_free(private_data, first + count)) {
+        count++;
+    }
+
+    // Link the run in memory, then write it to the FATs with one write per copy
+    for (uint32_t i = 0; i < count; i++) {
+        fat_set_fat_table_entry(private_data, first + i, i + 1 < count ? first + i + 1 : FAT32_END_OF_CHAIN);
+    }
+    status_t result = fat_write_fat_entries(disk, first, count);
+    if (result != ALL_OK) {
+        fat_release_clusters(disk, first, count);
+        return result;
+    }
+    private_data->next_free_cluster = first + count;
+
+    *out_first = first;
+    *out_count = count;
+    return ALL_OK;
+}
+
+// Number of clusters in the chain
+static uint32_t
+fat_get_chain_length(struct fat_cluster_chain* chain)
+{
+    if (chain->count == 0) {
+        return 0;
+    }
+    struct fat_extent* last = &chain->extents[chain->count - 1];
+    return last->file_cluster + last->cluster_count;
+}
+
+// Cluster number of the `file_cluster`th cluster of the chain
+static uint32_t
+fat_get_chain_cluster(struct fat_cluster_chain* chain, uint32_t file_cluster)
+{
+    struct fat_extent* extent = fat_get_extent_for_cluster(chain, file_cluster);
+    return extent ? extent->first_cluster + (file_cluster - extent->file_cluster) : FAT_UNUSED_CLUSTER;
+}
+
+/// @brief Grows the cluster chain of a file until it holds `size` bytes. The clusters are allocated in contiguous runs
+/// and linked after the last cluster of the file. An empty file gets its first cluster in `item`, and the caller writes
+/// the entry back.
+/// @param disk The disk
+/// @param item The directory entry of the file
+/// @param chain The cluster chain of the file
+/// @param size The size the chain must hold, in bytes
+/// @return ALL_OK, or ENOSPACE if the disk doesn't have enough free clusters. Nothing is allocated then.
+static status_t
+fat_grow_cluster_chain(
+  struct disk* disk,
+  struct fat_directory_item* item,
+  struct fat_cluster_chain* chain,
+  uint32_t size
+)
+{
+    status_t result = ALL_OK;
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    uint32_t cluster_size = private_data->header.primary.sectors_per_cluster * disk->sector_size;
+    uint32_t needed = (size + cluster_size - 1) / cluster_size;
+    uint32_t length = fat_get_chain_length(chain);
+
+    if (needed > length && needed - length > private_data->free_cluster_count) {
+        return ERROR(ENOSPACE);
+    }
+
+    while (length < needed) {
+        uint32_t last = length > 0 ? fat_get_chain_cluster(chain, length - 1) : 0;
+        uint32_t first = 0;
+        uint32_t count = 0;
+        result = fat_allocate_clusters(disk, last ? last + 1 : 0, needed - length, &first, &count);
+        if (result != ALL_OK) {
+            break;
+        }
+
+        if (last) {
+            result = fat_set_fat_entry(disk, last, first);
+        } else {
+            item->first_cluster_high = first >> 16;
+            item->first_cluster_low = first & 0xFFFF;
+        }
+        if (result == ALL_OK) {
+            result = fat_append_clusters(chain, first, count, length);
+        }
+        if (result != ALL_OK) {
+            // Unlink the run from the file again and give it back
+            if (last) {
+                fat_set_fat_entry(disk, last, FAT32_END_OF_CHAIN);
+            } else {
+                item->first_cluster_high = 0;
+                item->first_cluster_low = 0;
+            }
+            fat_release_clusters(disk, first, count);
+            break;
+        }
+        length += count;
+    }
+    // The free count in FSInfo is only a hint, so failing to update it doesn't fail the call
+    fat32_write_fs_info(disk);
+    return result;
+}
+
+/// @brief Frees the clusters of a file past its first `size` bytes. The chain is cut first, then the clusters after
+/// the cut are freed. A file cut to 0 loses its first cluster in `item`, and the caller writes the entry back.
+/// @param disk The disk
+/// @param item The directory entry of the file
+/// @param chain The cluster chain of the file
+/// @param size The size the chain must still hold, in bytes
+/// @return Status code
+static status_t
+fat_shrink_cluster_chain(
+  struct disk* disk,
+  struct fat_directory_item* item,
+  struct fat_cluster_chain* chain,
+  uint32_t size
+)
+{
+    status_t result = ALL_OK;
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    uint32_t cluster_size = private_data->header.primary.sectors_per_cluster * disk->sector_size;
+    uint32_t keep = (size + cluster_size - 1) / cluster_size;
+    uint32_t length = fat_get_chain_length(chain);
+
+    if (keep >= length) {
+        return ALL_OK;
+    }
+
+    if (keep == 0) {
+        item->first_cluster_high = 0;
+        item->first_cluster_low = FAT_UNUSED_CLUSTER;
+    } else {
+        result = fat_set_fat_entry(disk, fat_get_chain_cluster(chain, keep - 1), FAT32_END_OF_CHAIN);
+        if (result != ALL_OK) {
+            return result;
+        }
+    }
+
+    // Free each extent past the cut with one write per FAT copy
+    for (uint32_t i = 0; i < chain->count && result == ALL_OK; i++) {
+        struct fat_extent* extent = &chain->extents[i];
+        if (extent->file_cluster + extent->cluster_count <= keep) {
+            continue;
+        }
+
+        uint32_t skip = keep > extent->file_cluster ? keep - extent->file_cluster : 0;
+        uint32_t first = extent->first_cluster + skip;
+        uint32_t count = extent->cluster_count - skip;
+        for (uint32_t j = 0; j < count; j++) {
+            fat_set_fat_table_entry(private_data, first + j, FAT_UNUSED_CLUSTER);
+        }
+        result = fat_write_fat_entries(disk, first, count);
+    }
+
+    // drop the freed clusters from the extents
+    while (chain->count > 0 && chain->extents[chain->count - 1].file_cluster >= keep) {
+        chain->count--;
+    }
+    if (chain->count > 0) {
+        struct fat_extent* last = &chain->extents[chain->count - 1];
+        if (last->file_cluster + last->cluster_count > keep) {
+            last->cluster_count = keep - last->file_cluster;
+        }
+    }
+    chain->hint = 0;
+    fat32_write_fs_info(disk);
+    return result;
+}
+
+// Reads `size` bytes at `offset` of a directory. `chain` is the cluster chain of a subdirectory, or 0 for the root
+// directory, which is a fixed area at `position` on the disk.
+static status_t
+fat_read_directory_area(
+  struct disk* disk,
+  struct fat_cluster_chain* chain,
+  uint64_t position,
+  uint32_t offset,
+  uint32_t size,
+  void* buffer
+)
+{
+    if (chain) {
+        return fat_read_internal(disk, chain, offset, size, buffer);
+    }
+
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    status_t result = disk_stream_seek(private_data->dir_stream, position + offset);
+    if (result != ALL_OK) {
+        return result;
+    }
+    return disk_stream_read(private_data->dir_stream, (char*)buffer, size);
+}
+
+// Byte position on the disk of `offset` in a directory. See `fat_read_directory_area()`.
+static status_t
+fat_get_directory_slot_position(
+  struct disk* disk,
+  struct fat_cluster_chain* chain,
+  uint64_t position,
+  uint32_t offset,
+  uint64_t* out_position
+)
+{
+    uint32_t contiguous = 0;
+    *out_position = position + offset;
+    return chain ? fat_get_disk_position(disk, chain, offset, out_position, &contiguous) : ALL_OK;
+}
+
+static bool
+fat_is_long_name_item(struct fat_directory_item* item)
+{
+    return (item->attributes & FAT16_LONG_NAME_ATTR_MASK) == FAT16_LONG_NAME_ATTRIBUTES;
+}
+
+// The checksum every long name entry stores of the 8.3 name that follows it
+static uint8_t
+fat_get_short_name_checksum(struct fat_directory_item* item)
+{
+    uint8_t checksum = 0;
+    for (int i = 0; i < FAT16_FILE_NAME_LENGTH; i++) {
+        checksum = ((checksum & 1) << 7) + (checksum >> 1) + item->file_name[i];
+    }
+    for (int i = 0; i < FAT16_FILE_EXT_LENGTH; i++) {
+        checksum = ((checksum & 1) << 7) + (checksum >> 1) + item->file_extension[i];
+    }
+    return checksum;
+}
+
+/// @brief Adds a long name entry to the long name being read. An entry out of sequence, or with another checksum than
+/// the entries before it, drops the name: it's left over from a deleted or renamed item.
+static void
+fat_parse_long_name_item(struct fat_long_name_parser* parser, struct fat_long_name_item* item)
+{
+    uint8_t sequence = item->sequence & FAT16_LONG_NAME_SEQUENCE_MASK;
+
+    if (item->sequence & FAT16_LONG_NAME_LAST) {
+        if (sequence == 0 || sequence > FAT16_LONG_NAME_MAX_ENTRIES) {
+            parser->active = false;
+            return;
+        }
+        memset(parser->characters, 0, sizeof(parser->characters));
+        parser->checksum = item->checksum;
+        parser->next_sequence = sequence;
+        parser->active = true;
+    } else if (!parser->active || sequence != parser->next_sequence || item->checksum != parser->checksum) {
+        parser->active = false;
+        return;
+    }
+
+    uint16_t* characters = &parser->characters[(sequence - 1) * FAT16_LONG_NAME_ENTRY_CHARS];
+    memcpy(characters, item->name1, sizeof(item->name1));
+    memcpy(characters + 5, item->name2, sizeof(item->name2));
+    memcpy(characters + 11, item->name3, sizeof(item->name3));
+    parser->next_sequence--;
+}
+
+/// @brief Ends the long name being read at the 8.3 entry `item`, and decodes it if it belongs to `item`.
+/// @param name Receives the long name. The kernel only has ASCII strings, so other characters become '_'.
+/// @return true if `item` has a long name
+static bool
+fat_finish_long_name(struct fat_long_name_parser* parser, struct fat_directory_item* item, char* name)
+{
+    bool complete = parser->active && parser->next_sequence == 0;
+    parser->active = false;
+    if (!complete || parser->checksum != fat_get_short_name_checksum(item)) {
+        return false;
+    }
+
+    // The name ends with a 0 character, and the rest of the last entry is padded with 0xFFFF
+    uint32_t length = 0;
+    for (; length < FAT16_LONG_NAME_LENGTH - 1; length++) {
+        uint16_t character = parser->characters[length];
+        if (character == 0x0000 || character == 0xFFFF) {
+            break;
+        }
+        name[length] = character < 0x80 ? (char)character : '_';
+    }
+    name[length] = 0;
+    return length > 0;
+}
+
+/// @brief Appends a copy of `item`, its position and its long name to the directory. The arrays grow a heap block at a
+/// time.
+/// @param directory The directory
+/// @param capacity The capacity of the item arrays
+/// @param names_capacity The capacity of `long_names`
+/// @param item The directory entry
+/// @param position The byte position of the directory entry on the disk
+/// @param long_name The long name, or 0
+/// @return Status code
+static status_t
+fat_append_directory_item(
+  struct fat_directory* directory,
+  uint32_t* capacity,
+  uint32_t* names_capacity,
+  struct fat_directory_item* item,
+  uint64_t position,
+  const char* long_name
+)
+{
+    if (directory->count == *capacity) {
+        uint32_t new_capacity = *capacity + HEAP_BLOCK_SIZE_BYTES / sizeof(struct fat_directory_item);
+        struct fat_directory_item* items = kzalloc(new_capacity * sizeof(struct fat_directory_item));
+        struct fat_directory_item_info* infos = kzalloc(new_capacity * sizeof(struct fat_directory_item_info));
+        if (!items || !infos) {
+            if (items) {
+                kfree(items);
+            }
+            if (infos) {
+                kfree(infos);
+            }
+            return ERROR(ENOMEM);
+        }
+        if (directory->items) {
+            memcpy(items, directory->items, directory->count * sizeof(struct fat_directory_item));
+            memcpy(infos, directory->infos, directory->count * sizeof(struct fat_directory_item_info));
+            kfree(directory->items);
+            kfree(directory->infos);
+        }
+        directory->items = items;
+        directory->infos = infos;
+        *capacity = new_capacity;
+    }
+
+    struct fat_directory_item_info* info = &directory->infos[directory->count];
+    info->position = position;
+    info->long_name = -1;
+
+    if (long_name) {
+        uint32_t length = strlen(long_name) + 1;
+        if (directory->long_names_size + length > *names_capacity) {
+            uint32_t new_capacity = *names_capacity + HEAP_BLOCK_SIZE_BYTES;
+            char* names = kzalloc(new_capacity);
+            if (!names) {
+                return ERROR(ENOMEM);
+            }
+            if (directory->long_names) {
+                memcpy(names, directory->long_names, directory->long_names_size);
+                kfree(directory->long_names);
+            }
+            directory->long_names = names;
+            *names_capacity = new_capacity;
+        }
+        info->long_name = directory->long_names_size;
+        memcpy(directory->long_names + directory->long_names_size, long_name, length);
+        directory->long_names_size += length;
+    }
+
+    memcpy(&directory->items[directory->count++], item, sizeof(struct fat_directory_item));
+    return ALL_OK;
+}
+
+/// @brief Reads the items of a directory in a single pass. The directory is read a chunk at a time up to the end
+/// marker, and only the items in use are kept: free slots and the volume label are dropped on the way. The long name
+/// entries in front of an item are decoded into its long name.
+/// @param disk The disk
+/// @param chain The cluster chain of a subdirectory, or 0 for the root directory
+/// @param position The byte position of the root directory on the disk. Ignored for subdirectories.
+/// @param size The size of the directory area in bytes
+/// @param directory The directory to fill in
+/// @return Status code
+static status_t
+fat_load_directory_items(
+  struct disk* disk,
+  struct fat_cluster_chain* chain,
+  uint64_t position,
+  uint32_t size,
+  struct fat_directory* directory
+)
+{
+    status_t result = ALL_OK;
+    uint32_t capacity = 0;
+    uint32_t names_capacity = 0;
+    char* long_name = 0;
+    struct fat_long_name_parser* parser = 0;
+
+    directory->items = 0;
+    directory->infos = 0;
+    directory->count = 0;
+    directory->long_names = 0;
+    directory->long_names_size = 0;
+
+    struct fat_directory_item* chunk = kzalloc(FAT16_DIRECTORY_CHUNK_SIZE);
+    long_name = kzalloc(FAT16_LONG_NAME_LENGTH);
+    parser = kzalloc(sizeof(struct fat_long_name_parser));
+    if (!chunk || !long_name || !parser) {
+        result = ERROR(ENOMEM);
+        goto out;
+    }
+
+    for (uint32_t offset = 0; offset < size; offset += FAT16_DIRECTORY_CHUNK_SIZE) {
+        uint32_t chunk_size = size - offset > FAT16_DIRECTORY_CHUNK_SIZE ? FAT16_DIRECTORY_CHUNK_SIZE : size - offset;
+        result = fat_read_directory_area(disk, chain, position, offset, chunk_size, chunk);
+        if (result != ALL_OK) {
+            goto out;
+        }
+
+        for (uint32_t i = 0; i < chunk_size / sizeof(struct fat_directory_item); i++) {
+            struct fat_directory_item* item = &chunk[i];
+            if (item->file_name[0] == FAT16_ITEM_END) {
+                goto out;
+            }
+            if (item->file_name[0] == FAT16_ITEM_DELETED) {
+                parser->active = false;
+                continue;
+            }
+            if (fat_is_long_name_item(item)) {
+                fat_parse_long_name_item(parser, (struct fat_long_name_item*)item);
+                continue;
+            }
+            if (item->attributes & FAT16_ATTR_VOLUME_ID) {
+                parser->active = false;
+                continue;
+            }
+
+            uint64_t item_position = 0;
+            result = fat_get_directory_slot_position(
+              disk, chain, position, offset + i * sizeof(struct fat_directory_item), &item_position
+            );
+            if (result != ALL_OK) {
+                goto out;
+            }
+
+            bool has_long_name = fat_finish_long_name(parser, item, long_name);
+            result = fat_append_directory_item(
+              directory, &capacity, &names_capacity, item, item_position, has_long_name ? long_name : 0
+            );
+            if (result != ALL_OK) {
+                goto out;
+            }
+        }
+    }
+
+out:
+    if (chunk) {
+        kfree(chunk);
+    }
+    if (long_name) {
+        kfree(long_name);
+    }
+    if (parser) {
+        kfree(parser);
+    }
+    if (result != ALL_OK) {
+        fat_free_directory_items(directory);
+        return result;
+    }
+
+    fat_build_directory_index(directory);
+    return ALL_OK;
+}
+
+struct fat_directory*
+fat_load_fat_directory(struct disk* disk, struct fat_directory_item* item)
+{
+    status_t result = ALL_OK;
+
+    if (!(item->attributes & FAT16_ATTR_SUBDIRECTORY)) {
+        return 0;
+    }
+
+    struct fat_directory* directory = (struct fat_directory*)kzalloc(sizeof(struct fat_directory));
+    if (!directory) {
+        return 0;
+    }
+
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    uint32_t cluster_size = private_data->header.primary.sectors_per_cluster * disk->sector_size;
+    int cluster = fat_get_first_cluster(item);
+    directory->sector_position = fat_cluster_to_sector(private_data, cluster);
+
+    // A subdirectory can span several clusters. The chain tells how many, and where they are.
+    struct fat_cluster_chain chain;
+    result = fat_load_cluster_chain(disk, cluster, &chain);
+    if (result != ALL_OK) {
+        goto out;
+    }
+
+    uint32_t size = 0;
+    if (chain.count > 0) {
+        struct fat_extent* last = &chain.extents[chain.count - 1];
+        size = (last->file_cluster + last->cluster_count) * cluster_size;
+    }
+
+    result = fat_load_directory_items(disk, &chain, 0, size, directory);
+    fat_free_cluster_chain(&chain);
+
+out:
+    if (result != ALL_OK) {
+        fat_free_directory(directory);
+        return 0;
+    }
+    return directory;
+}
+
+struct fat_directory_item*
+fat_clone_directory_item(struct fat_directory_item* item, size_t size)
+{
+    if (size < sizeof(struct fat_directory_item)) {
+        return 0;
+    }
+    struct fat_directory_item* clone = (struct fat_directory_item*)kzalloc(size);
+    if (!clone) {
+        return 0;
+    }
+    memcpy(clone, item, size);
+    return clone;
+}
+
+struct fat_item*
+fat_new_fat_item_or_directory_item(struct disk* disk, struct fat_directory_item* item)
+{
+    struct fat_item* fat_item = (struct fat_item*)kzalloc(sizeof(struct fat_item));
+    if (!fat_item) {
+        return 0;
+    }
+
+    if (item->attributes & FAT16_ATTR_SUBDIRECTORY) {
+        fat_item->directory = fat_load_fat_directory(disk, item);
+        fat_item->type = FAT_ITEM_TYPE_DIRECTORY;
+    } else {
+        // make a clone of the directory item here. `item` is a pointer that could be freed at any
+        // time.
+        fat_item->item = fat_clone_directory_item(item, sizeof(struct fat_directory_item));
+        fat_item->type = FAT_ITEM_TYPE_FILE;
+    }
+
+    return fat_item;
+}
+
+// FAT names are case-insensitive, so the hash is computed over the upper case name
+static uint32_t
+fat_hash_name(const char* name)
+{
+    uint32_t value = 0;
+    for (const char* c = name; *c; c++) {
+        char upper = (*c >= 'a' && *c <= 'z') ? *c - 'a' + 'A' : *c;
+        value = value * 31 + (unsigned char)upper;
+    }
+    return value;
+}
+
+static bool
+fat_is_item_in_use(struct fat_directory_item* item)
+{
+    return item->file_name[0] != FAT16_ITEM_END && item->file_name[0] != FAT16_ITEM_DELETED;
+}
+
+// The long name of an item of a loaded directory, or 0 if it only has an 8.3 name
+static const char*
+fat_get_long_name(struct fat_directory* directory, uint32_t index)
+{
+    int offset = directory->infos[index].long_name;
+    return offset >= 0 ? directory->long_names + offset : 0;
+}
+
+// Compares `name` with the name of an index node: the 8.3 name of item `node`, or the long name of item
+// `node - count`. FAT names are case-insensitive.
+static bool
+fat_node_has_name(struct fat_directory* directory, uint32_t node, const char* name)
+{
+    if (node >= directory->count) {
+        const char* long_name = fat_get_long_name(directory, node - directory->count);
+        return long_name && istrncmp(long_name, name, FAT16_LONG_NAME_LENGTH) == 0;
+    }
+
+    char short_name[MAX_PATH_LENGTH];
+    fat_get_full_relative_filename(&directory->items[node], short_name, sizeof(short_name));
+    return istrncmp(short_name, name, MAX_PATH_LENGTH) == 0;
+}
+
+/// @brief Builds the hash index of a loaded directory, so that looking up a name is O(1) instead of a scan that
+/// rebuilds the name of every item. Both the 8.3 name and the long name of an item are indexed. If there is no memory
+/// for the index, lookups fall back to the scan.
+static void
+fat_build_directory_index(struct fat_directory* directory)
+{
+    uint32_t node_count = directory->count * 2;
+
+    // about 2 names per bucket
+    uint32_t bucket_count = 1;
+    while (bucket_count * 2 < node_count) {
+        bucket_count *= 2;
+    }
+
+    // One allocation for both arrays. Every heap allocation takes at least a 4KB block anyway.
+    int* index = kzalloc((bucket_count + node_count) * sizeof(int));
+    if (!index) {
+        return;
+    }
+    directory->hash_heads = index;
+    directory->hash_next = index + bucket_count;
+    directory->hash_bucket_count = bucket_count;
+
+    for (uint32_t i = 0; i < bucket_count; i++) {
+        directory->hash_heads[i] = -1;
+    }
+
+    char short_name[MAX_PATH_LENGTH];
+    for (int i = directory->count - 1; i >= 0; i--) {
+        int long_node = directory->count + i;
+        directory->hash_next[i] = -1;
+        directory->hash_next[long_node] = -1;
+        if (!fat_is_item_in_use(&directory->items[i])) {
+            continue;
+        }
+
+        // Items are added from the last one, so every bucket lists its items in directory order
+        const char* long_name = fat_get_long_name(directory, i);
+        if (long_name) {
+            uint32_t bucket = fat_hash_name(long_name) & (bucket_count - 1);
+            directory->hash_next[long_node] = directory->hash_heads[bucket];
+            directory->hash_heads[bucket] = long_node;
+        }
+
+        fat_get_full_relative_filename(&directory->items[i], short_name, sizeof(short_name));
+        uint32_t bucket = fat_hash_name(short_name) & (bucket_count - 1);
+        directory->hash_next[i] = directory->hash_heads[bucket];
+        directory->hash_heads[bucket] = i;
+    }
+}
+
+// Finds the item with the 8.3 name or the long name `name`
+struct fat_directory_item*
+fat_find_item_in_directory(struct fat_directory* directory, const char* name)
+{
+    if (!directory->hash_heads) {
+        for (uint32_t i = 0; i < directory->count; i++) {
+            if (fat_node_has_name(directory, i, name) || fat_node_has_name(directory, directory->count + i, name)) {
+                return &directory->items[i];
+            }
+        }
+        return 0;
+    }
+
+    uint32_t bucket = fat_hash_name(name) & (directory->hash_bucket_count - 1);
+    for (int node = directory->hash_heads[bucket]; node >= 0; node = directory->hash_next[node]) {
+        if (fat_node_has_name(directory, node, name)) {
+            return &directory->items[node % directory->count];
+        }
+    }
+    return 0;
+}
+
+// The dentry cache compares names exactly, and FAT names are case-insensitive. Every spelling of a name uses the upper
+// case dentry, so there is a single dentry to drop when the item changes.
+static void
+fat_get_dentry_name(const char* name, char* out, size_t size)
+{
+    size_t i = 0;
+    for (; name[i] && i < size - 1; i++) {
+        out[i] = (name[i] >= 'a' && name[i] <= 'z') ? name[i] - 'a' + 'A' : name[i];
+    }
+    out[i] = 0;
+}
+
+static void
+fat_invalidate_dentry(struct disk* disk, uint32_t parent_id, const char* name)
+{
+    char dentry_name[MAX_PATH_LENGTH];
+    fat_get_dentry_name(name, dentry_name, sizeof(dentry_name));
+    dentry_invalidate(disk, parent_id, dentry_name);
+}
+
+/// @brief Looks up `name` in a directory, going to the disk only if the dentry cache doesn't know the answer.
+/// @param disk The disk
+/// @param parent The directory entry of the directory to search, or 0 for the root directory
+/// @param parent_id The dentry ID of the directory to search
+/// @param name The name to look for
+/// @param out_data Receives a copy of the directory entry of `name`, and where it is on the disk
+/// @param out_id Receives the dentry ID of `name`, to look up its children
+/// @return true if `name` exists in the directory
+static bool
+fat_lookup(
+  struct disk* disk,
+  struct fat_directory_item* parent,
+  uint32_t parent_id,
+  const char* name,
+  struct fat_dentry_data* out_data,
+  uint32_t* out_id
+)
+{
+    char dentry_name[MAX_PATH_LENGTH];
+    fat_get_dentry_name(name, dentry_name, sizeof(dentry_name));
+
+    struct dentry* dentry = dentry_lookup(disk, parent_id, dentry_name);
+    if (dentry) {
+        if (dentry->negative) {
+            return false;
+        }
+        memcpy(out_data, dentry->data, sizeof(struct fat_dentry_data));
+        *out_id = dentry->id;
+        return true;
+    }
+
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    struct fat_directory* directory = parent ? fat_load_fat_directory(disk, parent) : &private_data->root_directory;
+    if (!directory) {
+        return false;
+    }
+
+    struct fat_directory_item* item = fat_find_item_in_directory(directory, name);
+    if (item) {
+        memcpy(&out_data->item, item, sizeof(struct fat_directory_item));
+        out_data->position = directory->infos[item - directory->items].position;
+    }
+    dentry = dentry_add(disk, parent_id, dentry_name, item ? out_data : 0, item ? sizeof(struct fat_dentry_data) : 0);
+    if (item) {
+        *out_id = dentry ? dentry->id : DENTRY_INVALID_ID;
+    }
+
+    if (parent) {
+        fat_free_directory(directory);
+    }
+    return item != 0;
+}
+
+/// @brief Follows `path` from the root directory. Only the directories on the path that miss the dentry cache are
+/// loaded from the disk.
+/// @param disk The disk
+/// @param path The path, without the drive
+/// @param lookup Receives the item at the end of the path, and the directory that holds it
+/// @return ALL_OK if every directory on the path exists. `lookup->found` tells if the last part of the path exists.
+static status_t
+fat_lookup_path(struct disk* disk, struct path_part* path, struct fat_path_lookup* lookup)
+{
+    memset(lookup, 0, sizeof(struct fat_path_lookup));
+    lookup->parent_is_root = true;
+    lookup->parent_id = DENTRY_ROOT_ID;
+
+    for (struct path_part* part = path; part; part = part->next) {
+        struct fat_dentry_data data;
+        lookup->name = part->name;
+        lookup->found = fat_lookup(
+          disk, lookup->parent_is_root ? 0 : &lookup->parent, lookup->parent_id, part->name, &data, &lookup->id
+        );
+        if (!lookup->found) {
+            return part->next ? ERROR(EINVPATH) : ALL_OK;
+        }
+
+        lookup->item = data.item;
+        lookup->position = data.position;
+        if (part->next) {
+            if (!(lookup->item.attributes & FAT16_ATTR_SUBDIRECTORY)) {
+                return ERROR(EINVPATH);
+            }
+            lookup->parent = lookup->item;
+            lookup->parent_id = lookup->id;
+            lookup->parent_is_root = false;
+        }
+    }
+    return ALL_OK;
+}
+
+// Reads the root directory again after an item was added to it or removed from it
+static status_t
+fat_reload_root_directory(struct disk* disk)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    fat_free_directory_items(&private_data->root_directory);
+    return fat_get_root_directory(disk, private_data, &private_data->root_directory);
+}
+
+/// @brief Writes a directory entry back to the disk. The in-memory root directory is kept in sync, because root
+/// lookups that miss the dentry cache search it instead of the disk.
+/// @param disk The disk
+/// @param parent_id The dentry ID of the directory holding the entry
+/// @param position The byte position of the directory entry on the disk
+/// @param item The new directory entry
+/// @return Status code
+static status_t
+fat_write_directory_item(struct disk* disk, uint32_t parent_id, uint64_t position, struct fat_directory_item* item)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    struct fat_directory* root = &private_data->root_directory;
+
+    status_t result = disk_stream_seek(private_data->dir_stream, position);
+    if (result != ALL_OK) {
+        return result;
+    }
+    result = disk_stream_write(private_data->dir_stream, (const char*)item, sizeof(struct fat_directory_item));
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    if (parent_id != DENTRY_ROOT_ID) {
+        return ALL_OK;
+    }
+
+    // The same item with a new size or first cluster is updated in place. The name index is still right.
+    for (uint32_t i = 0; i < root->count; i++) {
+        if (root->infos[i].position == position) {
+            if (memcmp(&root->items[i], item, FAT16_FILE_NAME_LENGTH + FAT16_FILE_EXT_LENGTH) == 0) {
+                memcpy(&root->items[i], item, sizeof(struct fat_directory_item));
+                return ALL_OK;
+            }
+            break;
+        }
+    }
+    return fat_reload_root_directory(disk);
+}
+
+static bool
+fat_is_valid_short_name_char(char c)
+{
+    if (c <= ' ' || c == 0x7F) {
+        return false;
+    }
+    for (const char* invalid = "\"*+,./:;<=>?[\\]|"; *invalid; invalid++) {
+        if (c == *invalid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Copies `length` characters of `name` upper-cased into a field of a directory entry, which is padded with spaces
+static status_t
+fat_set_short_name_field(uint8_t* field, size_t field_length, const char* name, size_t length)
+{
+    if (length > field_length) {
+        return ERROR(EINVARG);
+    }
+
+    memset(field, ' ', field_length);
+    for (size_t i = 0; i < length; i++) {
+        if (!fat_is_valid_short_name_char(name[i])) {
+            return ERROR(EINVARG);
+        }
+        field[i] = (name[i] >= 'a' && name[i] <= 'z') ? name[i] - 'a' + 'A' : name[i];
+    }
+    return ALL_OK;
+}
+
+/// @brief Sets the 8.3 name of a directory entry.
+/// @return ALL_OK, or EINVARG if `name` isn't a valid 8.3 name
+static status_t
+fat_set_short_name(struct fat_directory_item* item, const char* name)
+{
+    size_t length = strlen(name);
+    size_t name_length = length;
+    for (size_t i = 0; i < length; i++) {
+        if (name[i] == '.') {
+            name_length = i;
+            break;
+        }
+    }
+    if (name_length == 0) {
+        return ERROR(EINVARG);
+    }
+
+    status_t result = fat_set_short_name_field(item->file_name, FAT16_FILE_NAME_LENGTH, name, name_length);
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    // a name with a dot must have an extension
+    const char* extension = name + name_length + 1;
+    size_t extension_length = name_length < length ? length - name_length - 1 : 0;
+    if (name_length < length && extension_length == 0) {
+        return ERROR(EINVARG);
+    }
+    return fat_set_short_name_field(item->file_extension, FAT16_FILE_EXT_LENGTH, extension, extension_length);
+}
+
+// Checks if the lookup ended in the FAT16 root directory, which is a fixed area on the disk and not a cluster chain
+static bool
+fat16_is_fixed_root(struct disk* disk, struct fat_path_lookup* lookup)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    return lookup->parent_is_root && private_data->root_cluster == 0;
+}
+
+/// @brief Gets the area of the directory the lookup ended in: the cluster chain of a subdirectory or of the FAT32 root
+/// directory, or the position of the FAT16 root directory on the disk. See `fat_read_directory_area()`.
+/// @param disk The disk
+/// @param lookup The lookup
+/// @param chain Receives the cluster chain of the directory. It's left empty for the FAT16 root directory.
+/// @param out_position Receives the byte position of the FAT16 root directory
+/// @param out_size Receives the size of the directory area in bytes
+/// @return Status code
+static status_t
+fat_get_parent_directory_area(
+  struct disk* disk,
+  struct fat_path_lookup* lookup,
+  struct fat_cluster_chain* chain,
+  uint64_t* out_position,
+  uint32_t* out_size
+)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    struct fat_header* primary = &private_data->header.primary;
+
+    memset(chain, 0, sizeof(struct fat_cluster_chain));
+    if (fat16_is_fixed_root(disk, lookup)) {
+        *out_position = (uint64_t)private_data->root_directory.sector_position * primary->bytes_per_sector;
+        *out_size = primary->root_dir_entries * sizeof(struct fat_directory_item);
+        return ALL_OK;
+    }
+
+    uint32_t first_cluster =
+      lookup->parent_is_root ? private_data->root_cluster : fat_get_first_cluster(&lookup->parent);
+    status_t result = fat_load_cluster_chain(disk, first_cluster, chain);
+    *out_position = 0;
+    *out_size = fat_get_chain_length(chain) * primary->sectors_per_cluster * disk->sector_size;
+    return result;
+}
+
+/// @brief Finds a free slot for a new directory entry in the directory the lookup ended in. A full subdirectory grows
+/// by a cluster, and so does the FAT32 root directory. The FAT16 root directory has a fixed size.
+/// @param disk The disk
+/// @param lookup The lookup of the new item
+/// @param out_position Receives the byte position of the free slot on the disk
+/// @return ALL_OK, or ENOSPACE if the directory is full
+static status_t
+fat_find_free_directory_slot(struct disk* disk, struct fat_path_lookup* lookup, uint64_t* out_position)
+{
+    status_t result = ALL_OK;
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    struct fat_header* primary = &private_data->header.primary;
+    uint32_t cluster_size = primary->sectors_per_cluster * disk->sector_size;
+    struct fat_cluster_chain chain;
+    memset(&chain, 0, sizeof(chain));
+
+    struct fat_directory_item* chunk = kzalloc(FAT16_DIRECTORY_CHUNK_SIZE);
+    char* zeroes = 0;
+    if (!chunk) {
+        result = ERROR(ENOMEM);
+        goto out;
+    }
+
+    uint64_t position = 0;
+    uint32_t size = 0;
+    result = fat_get_parent_directory_area(disk, lookup, &chain, &position, &size);
+    if (result != ALL_OK) {
+        goto out;
+    }
+    struct fat_cluster_chain* area_chain = fat16_is_fixed_root(disk, lookup) ? 0 : &chain;
+
+    for (uint32_t offset = 0; offset < size; offset += FAT16_DIRECTORY_CHUNK_SIZE) {
+        uint32_t chunk_size = size - offset > FAT16_DIRECTORY_CHUNK_SIZE ? FAT16_DIRECTORY_CHUNK_SIZE : size - offset;
+        result = fat_read_directory_area(disk, area_chain, position, offset, chunk_size, chunk);
+        if (result != ALL_OK) {
+            goto out;
+        }
+
+        for (uint32_t i = 0; i < chunk_size / sizeof(struct fat_directory_item); i++) {
+            if (fat_is_item_in_use(&chunk[i])) {
+                continue;
+            }
+
+            uint32_t item_offset = offset + i * sizeof(struct fat_directory_item);
+            result = fat_get_directory_slot_position(disk, area_chain, position, item_offset, out_position);
+            goto out;
+        }
+    }
+
+    if (fat16_is_fixed_root(disk, lookup)) {
+        result = ERROR(ENOSPACE);
+        goto out;
+    }
+
+    // The new cluster must read as free slots, up to an end marker. The chain isn't empty, so the entry of the
+    // directory is left alone. The FAT32 root directory doesn't have one.
+    result = fat_grow_cluster_chain(disk, &lookup->parent, &chain, size + cluster_size);
+    if (result != ALL_OK) {
+        goto out;
+    }
+    zeroes = kzalloc(cluster_size);
+    if (!zeroes) {
+        result = ERROR(ENOMEM);
+        goto out;
+    }
+    result = fat_write_internal(disk, &chain, size, cluster_size, zeroes, 0);
+    if (result != ALL_OK) {
+        goto out;
+    }
+
+    result = fat_get_directory_slot_position(disk, &chain, 0, size, out_position);
+
+out:
+    if (chunk) {
+        kfree(chunk);
+    }
+    if (zeroes) {
+        kfree(zeroes);
+    }
+    fat_free_cluster_chain(&chain);
+    return result;
+}
+
+/// @brief Marks the long name entries in front of the directory entry the lookup ended at as deleted. Systems with VFAT
+/// would drop them as orphans anyway, but systems without it would keep them forever.
+/// @param disk The disk
+/// @param lookup The lookup of the item being deleted
+/// @return Status code
+static status_t
+fat_delete_long_name_items(struct disk* disk, struct fat_path_lookup* lookup)
+{
+    status_t result = ALL_OK;
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    struct fat_cluster_chain chain;
+    // Positions of the long name entries in a row just before the current slot
+    uint64_t positions[FAT16_LONG_NAME_MAX_ENTRIES];
+    uint32_t count = 0;
+
+    struct fat_directory_item* chunk = kzalloc(FAT16_DIRECTORY_CHUNK_SIZE);
+    if (!chunk) {
+        return ERROR(ENOMEM);
+    }
+
+    uint64_t position = 0;
+    uint32_t size = 0;
+    result = fat_get_parent_directory_area(disk, lookup, &chain, &position, &size);
+    if (result != ALL_OK) {
+        goto out;
+    }
+    struct fat_cluster_chain* area_chain = fat16_is_fixed_root(disk, lookup) ? 0 : &chain;
+
+    for (uint32_t offset = 0; offset < size; offset += FAT16_DIRECTORY_CHUNK_SIZE) {
+        uint32_t chunk_size = size - offset > FAT16_DIRECTORY_CHUNK_SIZE ? FAT16_DIRECTORY_CHUNK_SIZE : size - offset;
+        result = fat_read_directory_area(disk, area_chain, position, offset, chunk_size, chunk);
+        if (result != ALL_OK) {
+            goto out;
+        }
+
+        for (uint32_t i = 0; i < chunk_size / sizeof(struct fat_directory_item); i++) {
+            if (chunk[i].file_name[0] == FAT16_ITEM_END) {
+                goto out;
+            }
+
+            uint64_t slot_position = 0;
+            result = fat_get_directory_slot_position(
+              disk, area_chain, position, offset + i * sizeof(struct fat_directory_item), &slot_position
+            );
+            if (result != ALL_OK) {
+                goto out;
+            }
+
+            if (fat_is_item_in_use(&chunk[i]) && fat_is_long_name_item(&chunk[i])) {
+                if (count < FAT16_LONG_NAME_MAX_ENTRIES) {
+                    positions[count++] = slot_position;
+                }
+                continue;
+            }
+
+            if (slot_position == lookup->position) {
+                uint8_t deleted = FAT16_ITEM_DELETED;
+                for (uint32_t j = 0; j < count && result == ALL_OK; j++) {
+                    result = disk_stream_seek(private_data->dir_stream, positions[j]);
+                    if (result == ALL_OK) {
+                        result = disk_stream_write(private_data->dir_stream, (const char*)&deleted, sizeof(deleted));
+                    }
+                }
+                goto out;
+            }
+            count = 0;
+        }
+    }
+
+out:
+    kfree(chunk);
+    fat_free_cluster_chain(&chain);
+    return result;
+}
+
+/// @brief Creates an empty file with the last name of the path, in the directory the lookup ended in.
+/// @param disk The disk
+/// @param lookup A lookup that didn't find the item. On success, it's filled in with the new file.
+/// @return Status code
+static status_t
+fat_create_file(struct disk* disk, struct fat_path_lookup* lookup)
+{
+    memset(&lookup->item, 0, sizeof(struct fat_directory_item));
+    status_t result = fat_set_short_name(&lookup->item, lookup->name);
+    if (result != ALL_OK) {
+        return result;
+    }
+    lookup->item.attributes = FAT16_ATTR_ARCHIVE;
+
+    result = fat_find_free_directory_slot(disk, lookup, &lookup->position);
+    if (result != ALL_OK) {
+        return result;
+    }
+    result = fat_write_directory_item(disk, lookup->parent_id, lookup->position, &lookup->item);
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    // drop the negative dentry
+    fat_invalidate_dentry(disk, lookup->parent_id, lookup->name);
+    lookup->found = true;
+    lookup->id = DENTRY_INVALID_ID;
+    return ALL_OK;
+}
+
+// Drops the dentries of an item under both of its names
+static void
+fat_invalidate_item_dentries(
+  struct disk* disk,
+  uint32_t parent_id,
+  struct fat_directory_item* item,
+  const char* long_name
+)
+{
+    char short_name[MAX_PATH_LENGTH];
+    fat_get_full_relative_filename(item, short_name, sizeof(short_name));
+    fat_invalidate_dentry(disk, parent_id, short_name);
+    if (long_name[0]) {
+        fat_invalidate_dentry(disk, parent_id, long_name);
+    }
+}
+
+/// @brief Finds the long name of the item the lookup ended at. A path can name the item either way, so the dentries of
+/// both names are dropped when it changes. This loads the directory, so it's only done for items about to change.
+/// @param disk The disk
+/// @param lookup A lookup that found the item
+/// @param out Receives the long name, or an empty string. At least FAT16_LONG_NAME_LENGTH bytes.
+static void
+fat_get_lookup_long_name(struct disk* disk, struct fat_path_lookup* lookup, char* out)
+{
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    out[0] = 0;
+
+    struct fat_directory* directory =
+      lookup->parent_is_root ? &private_data->root_directory : fat_load_fat_directory(disk, &lookup->parent);
+    if (!directory) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < directory->count; i++) {
+        if (directory->infos[i].position == lookup->position) {
+            const char* long_name = fat_get_long_name(directory, i);
+            if (long_name) {
+                strncpy(out, long_name, FAT16_LONG_NAME_LENGTH - 1);
+                out[FAT16_LONG_NAME_LENGTH - 1] = 0;
+            }
+            break;
+        }
+    }
+
+    if (!lookup->parent_is_root) {
+        fat_free_directory(directory);
+    }
+}
+
+// Writes the directory entry of an open file back after its size or first cluster changed
+static status_t
+fat_update_file_entry(struct disk* disk, struct fat_file_descriptor* descriptor)
+{
+    fat_invalidate_item_dentries(disk, descriptor->parent_id, descriptor->item->item, descriptor->long_name);
+    return fat_write_directory_item(disk, descriptor->parent_id, descriptor->entry_position, descriptor->item->item);
+}
+
+// Cuts an open file to `size` bytes, which must not be past its end
+static status_t
+fat_truncate_internal(struct disk* disk, struct fat_file_descriptor* descriptor, uint32_t size)
+{
+    struct fat_directory_item* item = descriptor->item->item;
+    status_t result = fat_shrink_cluster_chain(disk, item, &descriptor->chain, size);
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    item->file_size = size;
+    if (descriptor->position > size) {
+        descriptor->position = size;
+    }
+    return fat_update_file_entry(disk, descriptor);
+}
+
+/// @brief Opens a file or a directory. Writing to a file that doesn't exist creates it in its directory. The directory
+/// itself must exist. A file can be open for reading any number of times, or once for writing, but not both at once.
+/// @param disk The disk
+/// @param path The path, without the drive
+/// @param mode FILE_MODE_WRITE cuts the file to 0 bytes. FILE_MODE_APPEND writes at the end of the file.
+/// @return The file descriptor, or 0 on error
+void*
+fat_open(struct disk* disk, struct path_part* path, FILE_MODE mode)
+{
+    status_t result = ALL_OK;
+    struct fat_file_descriptor* descriptor = 0;
+    struct fat_path_lookup lookup;
+
+    descriptor = kzalloc(sizeof(struct fat_file_descriptor));
+    if (!descriptor) {
+        result = ERROR(ENOMEM);
+        goto out;
+    }
+
+    result = fat_lookup_path(disk, path, &lookup);
+    if (result != ALL_OK) {
+        goto out;
+    }
+
+    if (!lookup.found) {
+        if (mode == FILE_MODE_READ) {
+            result = ERROR(EIO);
+            goto out;
+        }
+        result = fat_create_file(disk, &lookup);
+        if (result != ALL_OK) {
+            goto out;
+        }
+    }
+
+    if (mode != FILE_MODE_READ) {
+        if (lookup.item.attributes & FAT16_ATTR_SUBDIRECTORY) {
+            result = ERROR(EINVARG);
+            goto out;
+        }
+        if (lookup.item.attributes & FAT16_ATTR_READ_ONLY) {
+            result = ERROR(EREADONLY);
+            goto out;
+        }
+    }
+
+    // Each descriptor has its own copy of the directory entry and of the cluster chain, so a file written through one
+    // descriptor can't be open through another one
+    struct fat_private_data* private_data = disk->private_data;
+    for (struct fat_file_descriptor* open = private_data->open_files; open; open = open->next) {
+        if (open->entry_position == lookup.position && (mode != FILE_MODE_READ || open->mode != FILE_MODE_READ)) {
+            result = ERROR(EBUSY);
+            goto out;
+        }
+    }
+
+    descriptor->item = fat_new_fat_item_or_directory_item(disk, &lookup.item);
+    if (!descriptor->item) {
+        result = ERROR(ENOMEM);
+        goto out;
+    }
+
+    descriptor->position = 0;
+    descriptor->mode = mode;
+    descriptor->entry_position = lookup.position;
+    descriptor->parent_id = lookup.parent_id;
+    if (mode != FILE_MODE_READ) {
+        fat_get_lookup_long_name(disk, &lookup, descriptor->long_name);
+    }
+
+    // Resolve the whole cluster chain now, so reads at any offset don't have to walk it
+    if (descriptor->item->type == FAT_ITEM_TYPE_FILE) {
+        result = fat_load_cluster_chain(disk, fat_get_first_cluster(descriptor->item->item), &descriptor->chain);
+        if (result != ALL_OK) {
+            goto out;
+        }
+
+        if (mode == FILE_MODE_WRITE) {
+            result = fat_truncate_internal(disk, descriptor, 0);
+        } else if (mode == FILE_MODE_APPEND) {
+            descriptor->position = descriptor->item->item->file_size;
+        }
+    }
+
+    descriptor->fs_data = private_data;
+    descriptor->next = private_data->open_files;
+    if (private_data->open_files) {
+        private_data->open_files->previous = descriptor;
+    }
+    private_data->open_files = descriptor;
+
+out:
+    if (result != ALL_OK) {
+        if (descriptor) {
+            fat_free_cluster_chain(&descriptor->chain);
+            fat_free_item(descriptor->item);
+            kfree(descriptor);
+        }
+        descriptor = 0;
+    }
+    return descriptor;
+}
+
+size_t
+fat_read(struct disk* disk, void* fd, size_t size, size_t count, char* out)
+{
+    status_t result = ALL_OK;
+
+    struct fat_file_descriptor* descriptor = fd;
+    if (descriptor->item->type != FAT_ITEM_TYPE_FILE || size == 0) {
+        return 0;
+    }
+    struct fat_directory_item* item = descriptor->item->item;
+
+    // Only whole items are read. All of them are read at once, so reading bytes (`size` 1) is as fast as one item.
+    uint32_t left = descriptor->position < item->file_size ? item->file_size - descriptor->position : 0;
+    size_t read_items = left / size < count ? left / size : count;
+    if (read_items == 0) {
+        return 0;
+    }
+
+    result = fat_read_internal(disk, &descriptor->chain, descriptor->position, read_items * size, out);
+    if (result != ALL_OK) {
+        return 0;
+    }
+    descriptor->position += read_items * size;
+    return read_items;
+}
+
+/// @brief Reads the file from `offset` into each buffer of `vectors` in turn, without moving the file position. The
+/// disk position is looked up once per extent rather than once per buffer, and buffers that follow each other in the
+/// same extent are read without seeking the stream again.
+/// @return The number of bytes read. It's less than the total size of the buffers at the end of the file.
+size_t
+fat_preadv(struct disk* disk, void* fd, struct file_io_vector* vectors, uint32_t count, uint32_t offset)
+{
+    struct fat_file_descriptor* descriptor = fd;
+    if (descriptor->item->type != FAT_ITEM_TYPE_FILE) {
+        return 0;
+    }
+
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    struct disk_stream* stream = private_data->data_stream;
+    uint32_t file_size = descriptor->item->item->file_size;
+    // Bytes left in the extent from the stream position. The stream is only seeked when it runs out.
+    uint32_t contiguous = 0;
+    size_t total = 0;
+
+    for (uint32_t i = 0; i < count && offset < file_size; i++) {
+        char* out = vectors[i].buffer;
+        uint32_t length = vectors[i].size < file_size - offset ? vectors[i].size : file_size - offset;
+
+        while (length > 0) {
+            if (contiguous == 0) {
+                uint64_t position = 0;
+                if (fat_get_disk_position(disk, &descriptor->chain, offset, &position, &contiguous) != ALL_OK ||
+                    contiguous == 0 || disk_stream_seek(stream, position) != ALL_OK) {
+                    return total;
+                }
+            }
+
+            uint32_t chunk_size = length < contiguous ? length : contiguous;
+            if (disk_stream_read(stream, out, chunk_size) != ALL_OK) {
+                return total;
+            }
+            offset += chunk_size;
+            out += chunk_size;
+            length -= chunk_size;
+            contiguous -= chunk_size;
+            total += chunk_size;
+        }
+    }
+    return total;
+}
+
+/// @brief Writes `count` items of `size` bytes at the position of the file, growing the file if needed. In append mode
+/// every write goes to the end of the file. The directory entry is written back once, after all the items.
+/// @param out_count Receives the number of whole items written, also when the write fails part of the way
+/// @return ALL_OK, ENOSPACE if the disk only had room for some of the items, or the error of the disk
+status_t
+fat_write(struct disk* disk, void* fd, size_t size, size_t count, const char* in, size_t* out_count)
+{
+    status_t result = ALL_OK;
+
+    *out_count = 0;
+    struct fat_file_descriptor* descriptor = fd;
+    if (descriptor->item->type != FAT_ITEM_TYPE_FILE || descriptor->mode == FILE_MODE_READ) {
+        return ERROR(EINVARG);
+    }
+    struct fat_directory_item* item = descriptor->item->item;
+    struct fat_private_data* private_data = (struct fat_private_data*)disk->private_data;
+    uint32_t cluster_size = private_data->header.primary.sectors_per_cluster * disk->sector_size;
+
+    if (descriptor->mode == FILE_MODE_APPEND) {
+        descriptor->position = item->file_size;
+    }
+
+    uint32_t first_cluster = fat_get_first_cluster(item);
+    uint32_t file_size = item->file_size;
+
+    // All the items go in one write. The total must fit in the 32-bit file size.
+    if (size == 0 || count == 0 || count > (UINT32_MAX - descriptor->position) / size) {
+        return ERROR(EINVARG);
+    }
+    uint32_t total = size * count;
+
+    uint32_t allocated = fat_get_chain_length(&descriptor->chain) * cluster_size;
+    if (descriptor->position + total > allocated) {
+        // Only whole items are written, so a full disk takes as many as the free clusters can hold
+        uint32_t available = allocated + private_data->free_cluster_count * cluster_size;
+        if (descriptor->position + total > available) {
+            uint32_t fitting = available > descriptor->position ? (available - descriptor->position) / size : 0;
+            total = fitting * size;
+            result = ERROR(ENOSPACE);
+        }
+        if (total == 0) {
+            goto out;
+        }
+        if (descriptor->position + total > allocated) {
+            status_t grown = fat_grow_cluster_chain(disk, item, &descriptor->chain, descriptor->position + total);
+            if (grown != ALL_OK) {
+                result = grown;
+                goto out;
+            }
+        }
+    }
+
+    uint32_t written = 0;
+    status_t write_result = fat_write_internal(disk, &descriptor->chain, descriptor->position, total, in, &written);
+    if (write_result != ALL_OK) {
+        result = write_result;
+    }
+    *out_count = written / size;
+
+    // A partly written item doesn't count, and the position stays after the last whole one
+    uint32_t end = descriptor->position + *out_count * size;
+    descriptor->position = end;
+    if (end > item->file_size) {
+        item->file_size = end;
+    }
+
+out:
+    if (item->file_size != file_size || fat_get_first_cluster(item) != first_cluster) {
+        status_t update_result = fat_update_file_entry(disk, descriptor);
+        if (result == ALL_OK) {
+            result = update_result;
+        }
+    }
+    return result;
+}
+
+/// @brief Cuts a file opened for writing to `size` bytes. The clusters past the new end go back to the free clusters.
+/// @return ALL_OK, or EINVARG if `size` is past the end of the file
+status_t
+fat_truncate(struct disk* disk, void* fd, uint32_t size)
+{
+    struct fat_file_descriptor* descriptor = fd;
+    if (descriptor->item->type != FAT_ITEM_TYPE_FILE) {
+        return ERROR(EINVARG);
+    }
+    if (descriptor->mode == FILE_MODE_READ) {
+        return ERROR(EREADONLY);
+    }
+    if (size > descriptor->item->item->file_size) {
+        return ERROR(EINVARG);
+    }
+    return fat_truncate_internal(disk, descriptor, size);
+}
+
+/// @brief Deletes a file: frees its clusters and marks its directory entry as deleted. Directories can't be deleted.
+/// @param disk The disk
+/// @param path The path, without the drive
+/// @return Status code, or EBUSY if the file is open
+status_t
+fat_unlink(struct disk* disk, struct path_part* path)
+{
+    struct fat_path_lookup lookup;
+    struct fat_cluster_chain chain;
+
+    status_t result = fat_lookup_path(disk, path, &lookup);
+    if (result != ALL_OK) {
+        return result;
+    }
+    if (!lookup.found) {
+        return ERROR(EINVPATH);
+    }
+    if (lookup.item.attributes & FAT16_ATTR_SUBDIRECTORY) {
+        return ERROR(EINVARG);
+    }
+    if (lookup.item.attributes & FAT16_ATTR_READ_ONLY) {
+        return ERROR(EREADONLY);
+    }
+
+    // An open descriptor keeps the cluster chain, and would write into the clusters after they are freed
+    struct fat_private_data* private_data = disk->private_data;
+    for (struct fat_file_descriptor* open = private_data->open_files; open; open = open->next) {
+        if (open->entry_position == lookup.position) {
+            return ERROR(EBUSY);
+        }
+    }
+
+    result = fat_load_cluster_chain(disk, fat_get_first_cluster(&lookup.item), &chain);
+    if (result != ALL_OK) {
+        return result;
+    }
+
+    char long_name[FAT16_LONG_NAME_LENGTH];
+    fat_get_lookup_long_name(disk, &lookup, long_name);
+    fat_invalidate_item_dentries(disk, lookup.parent_id, &lookup.item, long_name);
+
+    // The entries go first, so a failure half way leaks clusters instead of leaving an entry to freed clusters
+    result = fat_delete_long_name_items(disk, &lookup);
+    if (result == ALL_OK) {
+        lookup.item.file_name[0] = FAT16_ITEM_DELETED;
+        result = fat_write_directory_item(disk, lookup.parent_id, lookup.position, &lookup.item);
+    }
+    if (result == ALL_OK) {
+        result = fat_shrink_cluster_chain(disk, &lookup.item, &chain, 0);
+    }
+
+    fat_free_cluster_chain(&chain);
+    return result;
+}
+
+status_t
+fat_seek(void* private_data, uint32_t offset, FILE_SEEK_MODE mode)
+{
+    status_t result = ALL_OK;
+
+    struct fat_file_descriptor* descriptor = private_data;
+    struct fat_item* item = descriptor->item;
+
+    if (item->type != FAT_ITEM_TYPE_FILE) {
+        result = ERROR(EINVARG);
+        goto out;
+    }
+
+    struct fat_directory_item* file_item = item->item;
+    if (offset > file_item->file_size) {
+        result = ERROR(EIO);
+        goto out;
+    }
+
+    switch (mode) {
+        case FILE_SEEK_SET:
+            descriptor->position = offset;
+            break;
+        case FILE_SEEK_CUR:
+            descriptor->position += offset;
+            break;
+        case FILE_SEEK_END:
+            descriptor->position = file_item->file_size + offset;
+            break;
+        default:
+            result = ERROR(EINVARG);
+            break;
+    }
+
+out:
+    return result;
+}
+
+static void
+fat_get_stat(struct fat_directory_item* item, struct file_stat* stat)
+{
+    stat->size = item->file_size;
+    stat->flags = 0;
+    if (item->attributes & FAT16_ATTR_HIDDEN) {
+        stat->flags |= FILE_STAT_FLAG_HIDDEN;
+    }
+    if (item->attributes & FAT16_ATTR_SYSTEM) {
+        stat->flags |= FILE_STAT_FLAG_SYSTEM;
+    }
+    if (item->attributes & FAT16_ATTR_READ_ONLY) {
+        stat->flags |= FILE_STAT_FLAG_READONLY;
+    }
+    if (item->attributes & FAT16_ATTR_SUBDIRECTORY) {
+        stat->flags |= FILE_STAT_FLAG_DIRECTORY;
+    }
+    if (item->attributes & FAT16_ATTR_ARCHIVE) {
+        stat->flags |= FILE_STAT_FLAG_ARCHIVE;
+    }
+}
+
+status_t
+fat_stat(void* private_data, struct file_stat* stat)
+{
+    status_t result = ALL_OK;
+
+    struct fat_file_descriptor* descriptor = private_data;
+    struct fat_item* item = descriptor->item;
+
+    if (item->type != FAT_ITEM_TYPE_FILE) {
+        result = ERROR(EINVARG);
+        goto out;
+    }
+
+    fat_get_stat(item->item, stat);
+
+out:
+    return result;
+}
+
+status_t
+fat_close(void* private_data)
+{
+    struct fat_file_descriptor* descriptor = private_data;
+
+    if (descriptor->previous) {
+        descriptor->previous->next = descriptor->next;
+    } else {
+        descriptor->fs_data->open_files = descriptor->next;
+    }
+    if (descriptor->next) {
+        descriptor->next->previous = descriptor->previous;
+    }
+
+    fat_free_cluster_chain(&descriptor->chain);
+    fat_free_item(descriptor->item);
+    kfree(descriptor);
+    return ALL_OK;
+}
+
+/// @brief Opens a directory to list its items. The items are read from the disk a chunk at a time as they are listed,
+/// so listing a directory doesn't load it whole.
+/// @param disk The disk
+/// @param path The path of the directory, or 0 for the root directory
+/// @return The directory stream, or 0 on error
+void*
+fat_opendir(struct disk* disk, struct path_part* path)
+{
+    status_t result = ALL_OK;
+    struct fat_path_lookup lookup;
+
+    struct fat_directory_stream* stream = kzalloc(sizeof(struct fat_directory_stream));
+    if (!stream) {
+        return 0;
+    }
+
+    // A lookup of the root directory ends in the root directory. Any other ends at the directory, so the lookup is
+    // moved into it, and the directory area is found the same way for both.
+    result = fat_lookup_path(disk, path, &lookup);
+    if (result != ALL_OK) {
+        goto out;
+    }
+    if (path) {
+        if (!lookup.found || !(lookup.item.attributes & FAT16_ATTR_SUBDIRECTORY)) {
+            result = ERROR(EINVPATH);
+            goto out;
+        }
+        // ".." of a top level directory has cluster 0, which is the root directory
+        lookup.parent = lookup.item;
+        lookup.parent_is_root = fat_get_first_cluster(&lookup.item) == 0;
+    }
+
+    result = fat_get_parent_directory_area(disk, &lookup, &stream->chain, &stream->position, &stream->size);
+    stream->fixed_root = fat16_is_fixed_root(disk, &lookup);
+
+out:
+    if (result != ALL_OK) {
+        fat_free_cluster_chain(&stream->chain);
+        kfree(stream);
+        return 0;
+    }
+    return stream;
+}
+
+/// @brief Reads the next item of a directory. Free slots, the volume label and long name entries are skipped, and the
+/// item gets its long name if it has one.
+/// @return ALL_OK, or ENOMOREENTRIES after the last item
+status_t
+fat_readdir(struct disk* disk, void* private_data, struct file_dirent* entry)
+{
+    struct fat_directory_stream* stream = private_data;
+    struct fat_cluster_chain* chain = stream->fixed_root ? 0 : &stream->chain;
+
+    while (stream->offset < stream->size) {
+        if (stream->offset >= stream->chunk_offset + stream->chunk_size) {
+            uint32_t left = stream->size - stream->offset;
+            stream->chunk_offset = stream->offset;
+            stream->chunk_size = left > FAT16_DIRECTORY_CHUNK_SIZE ? FAT16_DIRECTORY_CHUNK_SIZE : left;
+            status_t result = fat_read_directory_area(
+              disk, chain, stream->position, stream->chunk_offset, stream->chunk_size, stream->chunk
+            );
+            if (result != ALL_OK) {
+                stream->chunk_size = 0;
+                return result;
+            }
+        }
+
+        struct fat_directory_item* item =
+          &stream->chunk[(stream->offset - stream->chunk_offset) / sizeof(struct fat_directory_item)];
+        stream->offset += sizeof(struct fat_directory_item);
+
+        if (item->file_name[0] == FAT16_ITEM_END) {
+            stream->offset = stream->size;
+            break;
+        }
+        if (item->file_name[0] == FAT16_ITEM_DELETED) {
+            stream->parser.active = false;
+            continue;
+        }
+        if (fat_is_long_name_item(item)) {
+            fat_parse_long_name_item(&stream->parser, (struct fat_long_name_item*)item);
+            continue;
+        }
+        if (item->attributes & FAT16_ATTR_VOLUME_ID) {
+            stream->parser.active = false;
+            continue;
+        }
+
+        if (!fat_finish_long_name(&stream->parser, item, entry->name)) {
+            fat_get_full_relative_filename(item, entry->name, sizeof(entry->name));
+        }
+        fat_get_stat(item, &entry->stat);
+        return ALL_OK;
+    }
+    return ERROR(ENOMOREENTRIES);
+}
+
+status_t
+fat_closedir(void* private_data)
+{
+    struct fat_directory_stream* stream = private_data;
+    fat_free_cluster_chain(&stream->chain);
+    kfree(stream);
+    return ALL_OK;
+}
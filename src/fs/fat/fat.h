@@ -1,8 +1,9 @@
-#ifndef FAT16_H
-#define FAT16_H
+#ifndef FAT_H
+#define FAT_H
 
 #include "../file.h"
 
 struct file_system* fat16_initialize();
+struct file_system* fat32_initialize();
 
 #endif
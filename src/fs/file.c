@@ -6,10 +6,13 @@
 #include "../string/string.h"
 #include "../system/sys.h"
 #include "../terminal/terminal.h"
-#include "fat/fat16.h"
+#include "dentry.h"
+#include "fat/fat.h"
 
 static struct file_system* file_systems[MAX_FILE_SYSTEM_COUNT];
+// The system-wide open-file table. Each open file is here once, with its state. Process descriptors refer to it.
 static struct file_descriptor* file_descriptors[MAX_FILE_DESCRIPTOR_COUNT];
+static uint32_t used_file_descriptors[MAX_FILE_DESCRIPTOR_COUNT / 32]; // bit set = slot in use
 
 static struct file_system**
 get_free_file_system_slot()
@@ -36,6 +39,7 @@ static void
 load_static_file_systems()
 {
     register_file_system(fat16_initialize());
+    register_file_system(fat32_initialize());
 }
 
 static void
@@ -49,30 +53,55 @@ initialize_file_systems()
 {
     memset(file_systems, 0, sizeof(file_systems));
     memset(file_descriptors, 0, sizeof(file_descriptors));
+    memset(used_file_descriptors, 0, sizeof(used_file_descriptors));
+    initialize_dentry_cache();
     load_file_systems();
 }
 
+// Finds the first clear bit of a bitmap of `count` bits, a word at a time. Returns -1 if every bit is set.
+static int
+find_first_zero(uint32_t* bitmap, int count)
+{
+    for (int i = 0; i < count / 32; i++) {
+        if (bitmap[i] != 0xFFFFFFFF) {
+            return i * 32 + __builtin_ctz(~bitmap[i]);
+        }
+    }
+    return -1;
+}
+
+static void
+set_bit(uint32_t* bitmap, int index, bool value)
+{
+    if (value) {
+        bitmap[index / 32] |= 1u << (index % 32);
+    } else {
+        bitmap[index / 32] &= ~(1u << (index % 32));
+    }
+}
+
 static status_t
 put_file_descriptor(struct file_descriptor** fd)
 {
-    status_t result = ERROR(ENOMEM);
-
-    for (int i = 0; i < MAX_FILE_DESCRIPTOR_COUNT; i++) {
-        if (file_descriptors[i] == 0) {
-            struct file_descriptor* new_fd = (struct file_descriptor*)kzalloc(sizeof(struct file_descriptor));
-            // File descriptors start at 1
-            new_fd->index = i + 1;
-            file_descriptors[i] = new_fd;
-            *fd = new_fd;
-            result = 0;
-            break;
-        }
+    int slot = find_first_zero(used_file_descriptors, MAX_FILE_DESCRIPTOR_COUNT);
+    if (slot < 0) {
+        return ERROR(ENOMEM);
     }
-    return result;
+
+    struct file_descriptor* new_fd = (struct file_descriptor*)kzalloc(sizeof(struct file_descriptor));
+    if (!new_fd) {
+        return ERROR(ENOMEM);
+    }
+    // File descriptors start at 1
+    new_fd->index = slot + 1;
+    file_descriptors[slot] = new_fd;
+    set_bit(used_file_descriptors, slot, true);
+    *fd = new_fd;
+    return ALL_OK;
 }
 
 static struct file_descriptor*
-get_file_descriptor(int fd)
+get_descriptor(int fd)
 {
     if (fd < 1 || fd > MAX_FILE_DESCRIPTOR_COUNT) {
         return 0;
@@ -80,6 +109,21 @@ get_file_descriptor(int fd)
     return file_descriptors[fd - 1];
 }
 
+// The descriptor of an open file. Directory descriptors don't count.
+static struct file_descriptor*
+get_file_descriptor(int fd)
+{
+    struct file_descriptor* descriptor = get_descriptor(fd);
+    return descriptor && !descriptor->directory ? descriptor : 0;
+}
+
+static struct file_descriptor*
+get_directory_descriptor(int fd)
+{
+    struct file_descriptor* descriptor = get_descriptor(fd);
+    return descriptor && descriptor->directory ? descriptor : 0;
+}
+
 static status_t
 remove_file_descriptor(int fd)
 {
@@ -87,6 +131,7 @@ remove_file_descriptor(int fd)
         return ERROR(EINVARG);
     }
     file_descriptors[fd - 1] = 0;
+    set_bit(used_file_descriptors, fd - 1, false);
     return ALL_OK;
 }
 
@@ -119,6 +164,7 @@ int
 fopen(const char* file_name, const char* mode)
 {
     status_t result = ALL_OK;
+    struct file_descriptor* fd = 0;
 
     struct path_root* path = path_parse(file_name, NULL);
 
@@ -150,20 +196,21 @@ fopen(const char* file_name, const char* mode)
         goto out;
     }
 
-    struct file_descriptor* fd = 0;
     result = put_file_descriptor(&fd);
     if (result != ALL_OK) {
+        disk->fs->close(private_data);
         goto out;
     }
     fd->data = private_data;
     fd->disk = disk;
 
 out:
+    path_free(path);
+
     // fopen returns 0 on error
     if (result != ALL_OK) {
-        fd->index = 0;
+        return 0;
     }
-
     return fd->index;
 }
 
@@ -190,6 +237,108 @@ out:
     return descriptor->disk->fs->read(descriptor->disk, descriptor->data, size, count, (char*)ptr);
 }
 
+/// @brief Reads the file from `offset` into each of the `count` buffers in turn, like `preadv()`. The position of the
+/// file doesn't move, so readers of records at known offsets don't need a seek per record.
+/// @return The number of bytes read. It's less than the total size of the buffers at the end of the file.
+size_t
+fpreadv(int fd, struct file_io_vector* vectors, uint32_t count, uint32_t offset)
+{
+    if (!vectors || count == 0) {
+        return 0;
+    }
+
+    struct file_descriptor* descriptor = get_file_descriptor(fd);
+    if (!descriptor || !descriptor->disk->fs->preadv) {
+        return 0;
+    }
+
+    return descriptor->disk->fs->preadv(descriptor->disk, descriptor->data, vectors, count, offset);
+}
+
+/// @brief Writes `count` items of `size` bytes to the file at its position. Like the C library, a short count is the
+/// only sign of an error here, and `ferror()` tells what it was.
+/// @return The number of whole items written. 0 if the file isn't open for writing, or its file system is read-only.
+size_t
+fwrite(const void* ptr, uint32_t size, uint32_t count, int fd)
+{
+    if (size == 0 || count == 0 || !ptr) {
+        return 0;
+    }
+
+    struct file_descriptor* descriptor = get_file_descriptor(fd);
+    if (!descriptor) {
+        return 0;
+    }
+
+    size_t written = 0;
+    status_t result = ERROR(EREADONLY);
+    if (descriptor->disk->fs->write) {
+        result = descriptor->disk->fs->write(
+          descriptor->disk, descriptor->data, size, count, (const char*)ptr, &written
+        );
+    }
+    if (result != ALL_OK && descriptor->error == ALL_OK) {
+        descriptor->error = result;
+    }
+    return written;
+}
+
+/// @brief Gets the first error a write to the file ran into (i.e., a full disk or a failed disk write). It sticks until
+/// the file is closed, so a caller can check it once after many writes.
+/// @return ALL_OK if every write so far succeeded, or EINVARG if `fd` isn't an open file
+status_t
+ferror(int fd)
+{
+    struct file_descriptor* descriptor = get_file_descriptor(fd);
+    if (!descriptor) {
+        return ERROR(EINVARG);
+    }
+    return descriptor->error;
+}
+
+/// @brief Cuts the file to `size` bytes.
+status_t
+ftruncate(int fd, uint32_t size)
+{
+    struct file_descriptor* descriptor = get_file_descriptor(fd);
+    if (!descriptor) {
+        return ERROR(EINVARG);
+    }
+    if (!descriptor->disk->fs->truncate) {
+        return ERROR(EREADONLY);
+    }
+    return descriptor->disk->fs->truncate(descriptor->disk, descriptor->data, size);
+}
+
+/// @brief Deletes the file at `file_name`.
+status_t
+funlink(const char* file_name)
+{
+    status_t result = ALL_OK;
+
+    struct path_root* path = path_parse(file_name, NULL);
+    if (!path || !path->first) {
+        result = ERROR(EINVPATH);
+        goto out;
+    }
+
+    struct disk* disk = get_disk(path->drive_number);
+    if (!disk || !disk->fs) {
+        result = ERROR(EIO);
+        goto out;
+    }
+    if (!disk->fs->unlink) {
+        result = ERROR(EREADONLY);
+        goto out;
+    }
+
+    result = disk->fs->unlink(disk, path->first);
+
+out:
+    path_free(path);
+    return result;
+}
+
 status_t
 fseek(int fd, uint32_t offset, FILE_SEEK_MODE mode)
 {
@@ -252,3 +401,163 @@ out:
     }
     return result;
 }
+
+/// @brief Makes sure everything written to the file has reached the disk. The disk cache doesn't know which sectors
+/// belong to which file, so this flushes the whole disk the file is on.
+status_t
+fsync(int fd)
+{
+    struct file_descriptor* descriptor = get_file_descriptor(fd);
+    if (!descriptor) {
+        return ERROR(EINVARG);
+    }
+    return disk_flush(descriptor->disk);
+}
+
+/// @brief Opens the directory at `path` to list its items with `readdir()`.
+/// @return The directory descriptor, or 0 on error
+int
+opendir(const char* path)
+{
+    status_t result = ALL_OK;
+    struct file_descriptor* fd = 0;
+
+    struct path_root* root = path_parse(path, NULL);
+    if (!root) {
+        result = ERROR(EINVPATH);
+        goto out;
+    }
+
+    struct disk* disk = get_disk(root->drive_number);
+    if (!disk || !disk->fs) {
+        result = ERROR(EIO);
+        goto out;
+    }
+    if (!disk->fs->opendir) {
+        result = ERROR(EFSNOTSUPPORTED);
+        goto out;
+    }
+
+    // `root->first` is 0 for the root directory
+    void* private_data = disk->fs->opendir(disk, root->first);
+    if (!private_data) {
+        result = ERROR(EIO);
+        goto out;
+    }
+
+    result = put_file_descriptor(&fd);
+    if (result != ALL_OK) {
+        disk->fs->closedir(private_data);
+        goto out;
+    }
+    fd->data = private_data;
+    fd->disk = disk;
+    fd->directory = true;
+
+out:
+    path_free(root);
+
+    // opendir returns 0 on error
+    if (result != ALL_OK) {
+        return 0;
+    }
+    return fd->index;
+}
+
+/// @brief Reads the next item of the directory. Items come in the order they are stored in.
+/// @return ALL_OK, or ENOMOREENTRIES after the last item
+status_t
+readdir(int fd, struct file_dirent* entry)
+{
+    if (!entry) {
+        return ERROR(EINVARG);
+    }
+
+    struct file_descriptor* descriptor = get_directory_descriptor(fd);
+    if (!descriptor) {
+        return ERROR(EINVARG);
+    }
+    return descriptor->disk->fs->readdir(descriptor->disk, descriptor->data, entry);
+}
+
+status_t
+closedir(int fd)
+{
+    struct file_descriptor* descriptor = get_directory_descriptor(fd);
+    if (!descriptor) {
+        return ERROR(EINVARG);
+    }
+
+    status_t result = descriptor->disk->fs->closedir(descriptor->data);
+    if (result == ALL_OK) {
+        kfree(descriptor);
+        result = remove_file_descriptor(fd);
+    }
+    return result;
+}
+
+/// @brief Adds an open file or directory to a process' file table.
+/// @param table The file table of the process
+/// @param fd The descriptor in the system-wide open-file table, from `fopen()` or `opendir()`
+/// @return The descriptor in `table`, or 0 if the table is full
+int
+file_table_add(struct file_table* table, int fd)
+{
+    int slot = find_first_zero(table->used, MAX_FILE_DESCRIPTORS_PER_PROCESS);
+    if (slot < 0 || !get_descriptor(fd)) {
+        return 0;
+    }
+    table->descriptors[slot] = fd;
+    set_bit(table->used, slot, true);
+    // Process descriptors also start at 1
+    return slot + 1;
+}
+
+/// @brief Gets the system-wide descriptor behind a process descriptor.
+/// @return The descriptor for `fread()`, `readdir()`, etc., or 0 if `fd` isn't open in `table`
+int
+file_table_get(struct file_table* table, int fd)
+{
+    if (fd < 1 || fd > MAX_FILE_DESCRIPTORS_PER_PROCESS) {
+        return 0;
+    }
+    return table->descriptors[fd - 1];
+}
+
+/// @brief Drops a process descriptor. The caller closes the open file or directory behind it.
+void
+file_table_remove(struct file_table* table, int fd)
+{
+    if (fd < 1 || fd > MAX_FILE_DESCRIPTORS_PER_PROCESS) {
+        return;
+    }
+    table->descriptors[fd - 1] = 0;
+    set_bit(table->used, fd - 1, false);
+}
+
+/// @brief Closes a process descriptor, and the open file or directory behind it.
+status_t
+file_table_close(struct file_table* table, int fd)
+{
+    struct file_descriptor* descriptor = get_descriptor(file_table_get(table, fd));
+    if (!descriptor) {
+        return ERROR(EINVARG);
+    }
+
+    status_t result = descriptor->directory ? closedir(descriptor->index) : fclose(descriptor->index);
+    if (result == ALL_OK) {
+        file_table_remove(table, fd);
+    }
+    return result;
+}
+
+/// @brief Closes everything a process left open. This is called when the process exits.
+void
+file_table_close_all(struct file_table* table)
+{
+    for (int i = 0; i < MAX_FILE_DESCRIPTORS_PER_PROCESS; i++) {
+        if (table->descriptors[i]) {
+            file_table_close(table, i + 1);
+        }
+    }
+}
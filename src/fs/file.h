@@ -1,9 +1,11 @@
 #ifndef FILE_H
 #define FILE_H
 
+#include "../config.h"
 #include "../disk/disk.h"
 #include "../status.h"
 #include "path_parser.h"
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -37,12 +39,34 @@ enum
 // forward declaration
 struct disk;
 struct file_stat;
+struct file_dirent;
+struct file_io_vector;
 typedef status_t (*FS_RESOLVE_FUNCTION)(struct disk* disk);
 typedef void* (*FS_OPEN_FUNCTION)(struct disk* disk, struct path_part* path, FILE_MODE mode);
 typedef size_t (*FS_READ_FUNCTION)(struct disk* disk, void* private_data, size_t size, size_t count, char* out);
+typedef size_t (*FS_PREADV_FUNCTION)(
+  struct disk* disk,
+  void* private_data,
+  struct file_io_vector* vectors,
+  uint32_t count,
+  uint32_t offset
+);
+typedef status_t (*FS_WRITE_FUNCTION)(
+  struct disk* disk,
+  void* private_data,
+  size_t size,
+  size_t count,
+  const char* in,
+  size_t* out_count
+);
+typedef status_t (*FS_TRUNCATE_FUNCTION)(struct disk* disk, void* private_data, uint32_t size);
+typedef status_t (*FS_UNLINK_FUNCTION)(struct disk* disk, struct path_part* path);
 typedef status_t (*FS_SEEK_FUNCTION)(void* private_data, uint32_t offset, FILE_SEEK_MODE mode);
 typedef status_t (*FS_STAT_FUNCTION)(void* private_data, struct file_stat* stat);
 typedef status_t (*FS_CLOSE_FUNCTION)(void* private_data);
+typedef void* (*FS_OPENDIR_FUNCTION)(struct disk* disk, struct path_part* path);
+typedef status_t (*FS_READDIR_FUNCTION)(struct disk* disk, void* private_data, struct file_dirent* entry);
+typedef status_t (*FS_CLOSEDIR_FUNCTION)(void* private_data);
 
 struct file_system
 {
@@ -50,9 +74,19 @@ struct file_system
     FS_RESOLVE_FUNCTION resolve;
     FS_OPEN_FUNCTION open;
     FS_READ_FUNCTION read;
+    // Optional. Reads at an offset into several buffers, without moving the file position.
+    FS_PREADV_FUNCTION preadv;
+    // Optional. File systems without them are read-only.
+    FS_WRITE_FUNCTION write;
+    FS_TRUNCATE_FUNCTION truncate;
+    FS_UNLINK_FUNCTION unlink;
     FS_SEEK_FUNCTION seek;
     FS_STAT_FUNCTION stat;
     FS_CLOSE_FUNCTION close;
+    // Optional. `path` is 0 for the root directory.
+    FS_OPENDIR_FUNCTION opendir;
+    FS_READDIR_FUNCTION readdir;
+    FS_CLOSEDIR_FUNCTION closedir;
 };
 
 struct file_descriptor
@@ -60,6 +94,10 @@ struct file_descriptor
     int index;
     struct disk* disk;
     void* data; // file's content
+    // Directory descriptors come from `opendir()` and only work with `readdir()` and `closedir()`
+    bool directory;
+    // The first error a write to the file ran into, for `ferror()`
+    status_t error;
 };
 
 struct file_stat
@@ -68,12 +106,48 @@ struct file_stat
     FILE_STAT_FLAGS flags; /* user defined flags for file */
 };
 
+// The files and directories a process has open. The descriptors of a process index this table, and each one refers to
+// the system-wide open-file table, which holds the state of the open file.
+struct file_table
+{
+    uint32_t used[MAX_FILE_DESCRIPTORS_PER_PROCESS / 32]; // bit set = descriptor in use
+    int descriptors[MAX_FILE_DESCRIPTORS_PER_PROCESS];
+};
+
+// One of the buffers `fpreadv()` reads into
+struct file_io_vector
+{
+    void* buffer;
+    size_t size;
+};
+
+// An item of a directory, as returned by `readdir()`
+struct file_dirent
+{
+    char name[MAX_FILE_NAME_LENGTH];
+    struct file_stat stat;
+};
+
 void initialize_file_systems();
 struct file_system* fs_resolve(struct disk* disk);
 int fopen(const char* file_name, const char* mode);
 size_t fread(void* ptr, uint32_t size, uint32_t count, int fd);
+size_t fpreadv(int fd, struct file_io_vector* vectors, uint32_t count, uint32_t offset);
+size_t fwrite(const void* ptr, uint32_t size, uint32_t count, int fd);
+status_t ferror(int fd);
+status_t ftruncate(int fd, uint32_t size);
+status_t funlink(const char* file_name);
 status_t fseek(int fd, uint32_t offset, FILE_SEEK_MODE mode);
 status_t fstat(int fd, struct file_stat* stat);
 status_t fclose(int fd);
+status_t fsync(int fd);
+int opendir(const char* path);
+status_t readdir(int fd, struct file_dirent* entry);
+status_t closedir(int fd);
+int file_table_add(struct file_table* table, int fd);
+int file_table_get(struct file_table* table, int fd);
+void file_table_remove(struct file_table* table, int fd);
+status_t file_table_close(struct file_table* table, int fd);
+void file_table_close_all(struct file_table* table);
 
 #endif
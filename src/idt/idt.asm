@@ -4,6 +4,7 @@ global isr_table
 global load_idt
 global enable_interrupts
 global disable_interrupts
+global halt
 
 extern interrupt_handle_wrapper
 
@@ -15,6 +16,14 @@ disable_interrupts:
     cli
     ret
 
+; Enables interrupts and halts the CPU until the next interrupt has been handled. `sti` takes effect after the next
+; instruction, so an interrupt that is already pending can't slip in between `sti` and `hlt`.
+halt:
+    sti
+    hlt
+    cli
+    ret
+
 load_idt:
     push ebp
     mov ebp, esp
@@ -1,5 +1,7 @@
 #include "idt.h"
 #include "../config.h"
+#include "../disk/buffer_cache.h"
+#include "../disk/queue.h"
 #include "../io/io.h"
 #include "../keyboard/keyboard.h"
 #include "../memory/memory.h"
@@ -10,6 +12,7 @@
 #include "../terminal/terminal.h"
 
 extern void load_idt(struct idtr_desc* ptr);
+extern void halt();
 extern void* isr_table[TOTAL_INTERRUPTS];
 
 static struct idt_desc idt_descriptors[TOTAL_INTERRUPTS];
@@ -53,6 +56,14 @@ save_task_state(struct task* task, struct interrupt_frame* frame)
     task->registers.ebx = frame->ebx;
 }
 
+/// @brief Returns true if the interrupt was raised while the CPU was running the kernel (ring 0) rather than a task.
+/// Note that `esp` and `ss` in the frame are not valid in that case, because the CPU doesn't push them.
+static bool
+interrupted_kernel(struct interrupt_frame* frame)
+{
+    return (frame->cs & 0x03) == 0;
+}
+
 void
 default_interrupt_handler()
 {
@@ -64,9 +75,10 @@ exception_handler(struct interrupt_frame* frame)
 {
     print("Exception occurred\n");
 
-    disable_interrupts();
+    // Closing the files of the process may use the file system, which another task may be in the middle of. Freeing
+    // the task releases the lock again.
+    kernel_lock_acquire();
     terminate_process(get_current_task()->process, -1);
-    enable_interrupts();
 
     // Send ack. Since we've already freed the process so there's nothing to return to, so call switch_task() to switch
     // to another process' task.
@@ -76,8 +88,23 @@ exception_handler(struct interrupt_frame* frame)
 }
 
 void*
-clock()
+clock(struct interrupt_frame* frame)
 {
+    // A PIO write may be waiting for the drive to take its first block, which raises no interrupt
+    disk_queue_poll();
+
+    // The kernel only lets interrupts in while it waits for a task to become runnable (see `wait_for_interrupt()`).
+    // It picks the next task itself once the interrupt that wakes one up comes.
+    if (interrupted_kernel(frame)) {
+        return 0;
+    }
+
+    // Start the periodic disk write-back, unless a task is in the middle of a syscall (and maybe of the buffer cache).
+    // This only queues the writes. IRQ 14 carries the data, so the tick doesn't wait for the drive.
+    if (!kernel_lock_is_held()) {
+        buffer_cache_tick();
+    }
+
     // Send ack before switching tasks. Once we call switch_task(), we will not return to this function.
     outb(0x20, 0x20);
     switch_task();
@@ -90,7 +117,9 @@ int80h_handler(struct interrupt_frame* frame)
     void* res = 0;
     int command = frame->eax;
 
+    kernel_lock_acquire();
     res = syscall(command, frame);
+    kernel_lock_release();
 
     return res;
 }
@@ -100,7 +129,11 @@ interrupt_handle_wrapper(int irq, struct interrupt_frame* frame)
 {
     void* result = 0;
 
-    if (interrupt_handlers[irq]) {
+    if (interrupt_handlers[irq] && interrupted_kernel(frame)) {
+        // The kernel enabled interrupts while waiting for the hardware. We are already on the kernel page, and there
+        // is no user task state to save.
+        result = interrupt_handlers[irq](frame);
+    } else if (interrupt_handlers[irq]) {
         struct task* current_task = get_current_task();
         switch_to_kernel_page();
         save_task_state(current_task, frame);
@@ -110,12 +143,31 @@ interrupt_handle_wrapper(int irq, struct interrupt_frame* frame)
         default_interrupt_handler();
     }
 
-    // send ack
+    // send ack. IRQs from the slave PIC need to be acknowledged on both PICs.
+    if (irq >= IRQ_28H && irq < IRQ_28H + 8) {
+        outb(0xA0, 0x20);
+    }
     outb(0x20, 0x20);
 
+    // The interrupt (i.e., a disk request completing) may have woken up a task blocked in the kernel. It runs now
+    // rather than at the next clock tick, and the interrupted task continues later from its saved registers. Syscalls
+    // return their result in the registers of the task, so they aren't left this way.
+    if (interrupt_handlers[irq] && !interrupted_kernel(frame) && irq != IRQ_80H) {
+        task_run_woken();
+    }
+
     return result;
 }
 
+/// @brief Halts the CPU until the next interrupt has been handled. Interrupts are enabled only while halting, and are
+/// disabled again when this function returns. The kernel calls this when no task can run (see `task_block()`), and
+/// during boot.
+void
+wait_for_interrupt()
+{
+    halt();
+}
+
 static void
 register_interrupt_handler(int irq, INTERRUPT_HANDLER handler)
 {
@@ -169,6 +221,7 @@ initialize_interrupt_handlers()
     register_interrupt_handler(IRQ_0EH, exception_handler);
     register_interrupt_handler(IRQ_20H, clock);
     register_interrupt_handler(IRQ_21H, keyboard_interrupt_handler);
+    register_interrupt_handler(IRQ_2EH, disk_interrupt_handler);
     register_interrupt_handler(IRQ_80H, int80h_handler);
 
     initialize_syscall_handlers();
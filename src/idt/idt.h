@@ -7,6 +7,8 @@
 #define IRQ_0EH 0x0E
 #define IRQ_20H 0x20
 #define IRQ_21H 0x21
+#define IRQ_28H 0x28
+#define IRQ_2EH 0x2E
 #define IRQ_80H 0x80
 
 struct idt_desc
@@ -49,5 +51,6 @@ void initialize_idt();
 void initialize_interrupt_handlers();
 void enable_interrupts();
 void disable_interrupts();
+void wait_for_interrupt();
 
 #endif
@@ -2,8 +2,12 @@ section .asm
 
 global inb
 global inw
+global insw
+global inl
 global outb
 global outw
+global outl
+global outsw
 
 ; write a byte to the specified port
 inb:
@@ -31,6 +35,37 @@ inw:
 	pop ebp
 	ret
 
+; read a double word from the specified port
+inl:
+	push ebp
+	mov ebp, esp
+
+	xor eax, eax
+	mov edx, [ebp+8]
+	in eax, dx
+
+	mov esp, ebp
+	pop ebp
+	ret
+
+; read `count` words from the specified port into the buffer
+; void insw(unsigned short port, void* buffer, unsigned int count)
+insw:
+	push ebp
+	mov ebp, esp
+	push edi
+
+	mov edx, [ebp+8]
+	mov edi, [ebp+12]
+	mov ecx, [ebp+16]
+	cld
+	rep insw
+
+	pop edi
+	mov esp, ebp
+	pop ebp
+	ret
+
 ; read a byte from the specified port
 outb:
 	push ebp
@@ -56,3 +91,33 @@ outw:
 	mov esp, ebp
 	pop ebp
 	ret
+
+; write a double word to the specified port
+outl:
+	push ebp
+	mov ebp, esp
+
+	mov eax, [ebp+12]
+	mov edx, [ebp+8]
+	out dx, eax
+
+	mov esp, ebp
+	pop ebp
+	ret
+
+; void outsw(unsigned short port, const void* buffer, unsigned int count)
+outsw:
+	push ebp
+	mov ebp, esp
+	push esi
+
+	mov edx, [ebp+8]
+	mov esi, [ebp+12]
+	mov ecx, [ebp+16]
+	cld
+	rep outsw
+
+	pop esi
+	mov esp, ebp
+	pop ebp
+	ret
@@ -27,9 +27,21 @@ _start:
     out 0x20, al                ; Send the *command* to master PIC via port 0x20
     mov al, 0x20                ; IRQ 0 mapped to INT 0x20. Following IRQs (1-7) are also mapped accordingly.
     out 0x21, al                ; Send the *data* to master PIC via port 0x21
+    mov al, 00000100b           ; Tell the master PIC that the slave PIC is cascaded on IRQ 2
+    out 0x21, al
     mov al, 00000001b           ; Set PIC to x86 mode
     out 0x21, al                ; We finish the initialization by sending the mode configuration to the *data* port.
 
+    ; Remap the slave PIC. Otherwise IRQ 8-15 (i.e., IRQ 14 from the primary ATA channel) land on the BIOS vectors.
+    mov al, 00010001b           ; Set PIC to initialization mode
+    out 0xA0, al                ; Send the *command* to slave PIC via port 0xA0
+    mov al, 0x28                ; IRQ 8 mapped to INT 0x28. Following IRQs (9-15) are also mapped accordingly.
+    out 0xA1, al                ; Send the *data* to slave PIC via port 0xA1
+    mov al, 00000010b           ; Tell the slave PIC its cascade identity (IRQ 2 on the master)
+    out 0xA1, al
+    mov al, 00000001b           ; Set PIC to x86 mode
+    out 0xA1, al
+
     ; Call our kernel
     call kernel_main
 
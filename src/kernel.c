@@ -61,11 +61,8 @@ kernel_main()
 
     launch_shell();
 
-    // Defer calling `enable_interrupts()` until the root program (i.e., shell) is launched. Otherwise, the kernel will
-    // try to switch to another task, but there is no other task to switch to.
-    enable_interrupts();
-
-    while (1) {}
+    // Run the root program (i.e., shell). Interrupts are enabled when it starts, and the boot stack isn't used anymore.
+    switch_task();
 }
 
 void
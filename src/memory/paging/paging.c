@@ -227,66 +227,98 @@ switch_to_user_page(struct task* task)
     switch_page(task->user_page);
 }
 
-/// @brief Copies the data from the user space to the kernel space.
+/// @brief Gets the physical address behind a user space virtual address. The kernel space maps all of the physical
+/// memory at the same addresses, so the kernel can read and write user memory through it without switching pages.
 /// @param task The task that contains the user space paging map.
-/// @param src The user space virtual address to copy from.
-/// @param dest The kernel space physical address to copy to.
-/// @param size The size of the data to copy.
-/// @return
+/// @param virtual_address The user space virtual address.
+/// @param writable Whether the page must be writable by the user program.
+/// @param physical_address_out Receives the physical address.
+/// @param size_out Receives the number of bytes from `virtual_address` to the end of its page.
+/// @return ALL_OK, or EPAGEFAULT if the user program can't access the address.
 status_t
-copy_data_from_user_space(struct task* task, void* src, void* dest, size_t size)
+get_user_space_physical_address(
+  struct task* task,
+  void* virtual_address,
+  bool writable,
+  void** physical_address_out,
+  size_t* size_out
+)
 {
-    status_t result = ALL_OK;
-    const size_t max_page_size_to_copy = PAGING_PAGE_SIZE_BYTES;
-
-    if (!task || !task->user_page || !dest || !src) {
-        return ERROR(EINVARG);
-    }
-
-    // TODO: allow copying more than 4KB
-    if (size <= 0 || size > max_page_size_to_copy) {
+    if (!task || !task->user_page || !physical_address_out || !size_out) {
         return ERROR(EINVARG);
     }
 
-    // temporary kernel space memory to copy the data from the user space
-    char* buf = kzalloc(size);
-    if (!buf) {
-        return ERROR(ENOMEM);
-    }
-
-    struct paging_map* user_page = task->user_page;
+    uint32_t offset = (uint32_t)virtual_address % PAGING_PAGE_SIZE_BYTES;
+    void* page = (void*)((uint32_t)virtual_address - offset);
 
-    // get the original table entry at address `buf` and save it for later
-    uint32_t original_table_entry = 0;
-    result = get_table_entry(user_page, buf, &original_table_entry);
+    uint32_t table_entry = 0;
+    status_t result = get_table_entry(task->user_page, page, &table_entry);
     if (result != ALL_OK) {
-        goto out;
+        return ERROR(EPAGEFAULT);
     }
 
-    // Map the user space virtual address `buf` (which points to some unknown physical address) to point to the kernel
-    // space physical address `buf`. The memory space is set to be read-only.
-    result = map_paging_addresses(user_page, buf, buf, max_page_size_to_copy, PAGING_IS_PRESENT);
-    if (result != ALL_OK) {
-        goto out;
+    uint32_t required_flags = PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | (writable ? PAGING_IS_WRITABLE : 0);
+    if ((table_entry & required_flags) != required_flags) {
+        return ERROR(EPAGEFAULT);
     }
 
-    // switch to the user space for a brief moment to be able to see the `src` address
-    switch_to_user_page(task);
-    memcpy(buf, src, size);
-    switch_to_kernel_page();
+    *physical_address_out = (void*)((table_entry & 0xfffff000) + offset);
+    *size_out = PAGING_PAGE_SIZE_BYTES - offset;
+    return ALL_OK;
+}
 
-    // restore the original table entry
-    result = set_table_entry(user_page, buf, original_table_entry);
-    if (result != ALL_OK) {
-        goto out;
+// Copies between a user space buffer and a kernel space buffer, a page of the user buffer at a time. Pages that are
+// next to each other in the user space can be anywhere in the physical memory.
+static status_t
+copy_user_space_data(struct task* task, void* user_address, void* kernel_address, size_t size, bool to_user)
+{
+    if (!user_address || !kernel_address || size == 0) {
+        return ERROR(EINVARG);
     }
 
-    // copy the data from the temporary space to the `dest`
-    memcpy(dest, buf, size);
+    while (size > 0) {
+        void* physical_address = 0;
+        size_t chunk_size = 0;
+        status_t result = get_user_space_physical_address(task, user_address, to_user, &physical_address, &chunk_size);
+        if (result != ALL_OK) {
+            return result;
+        }
+        if (chunk_size > size) {
+            chunk_size = size;
+        }
 
-out:
-    if (buf) {
-        kfree(buf);
+        if (to_user) {
+            memcpy(physical_address, kernel_address, chunk_size);
+        } else {
+            memcpy(kernel_address, physical_address, chunk_size);
+        }
+        user_address += chunk_size;
+        kernel_address += chunk_size;
+        size -= chunk_size;
     }
-    return result;
+    return ALL_OK;
+}
+
+/// @brief Copies the data from the user space to the kernel space.
+/// @param task The task that contains the user space paging map.
+/// @param src The user space virtual address to copy from.
+/// @param dest The kernel space physical address to copy to.
+/// @param size The size of the data to copy.
+/// @return
+status_t
+copy_data_from_user_space(struct task* task, void* src, void* dest, size_t size)
+{
+    return copy_user_space_data(task, src, dest, size, false);
+}
+
+/// @brief Copies the data from the kernel space to the user space.
+/// @param task The task that contains the user space paging map.
+/// @param src The kernel space physical address to copy from.
+/// @param dest The user space virtual address to copy to.
+/// @param size The size of the data to copy.
+/// @return
+status_t
+copy_data_to_user_space(struct task* task, void* src, void* dest, size_t size)
+{
+    return copy_user_space_data(task, dest, src, size, true);
 }
@@ -27,6 +27,14 @@ extern void set_user_segment_registers();
 struct paging_map* new_paging_map(uint8_t flags);
 status_t free_paging_map(struct paging_map* map);
 status_t copy_data_from_user_space(struct task* task, void* src, void* dest, size_t size);
+status_t copy_data_to_user_space(struct task* task, void* src, void* dest, size_t size);
+status_t get_user_space_physical_address(
+  struct task* task,
+  void* virtual_address,
+  bool writable,
+  void** physical_address_out,
+  size_t* size_out
+);
 status_t map_paging_addresses(
   struct paging_map* map,
   void* virtual_address,
@@ -0,0 +1,248 @@
+#include "shared_memory.h"
+#include "../../string/string.h"
+#include "../../task/process.h"
+#include "../../task/task.h"
+#include "../heap/kheap.h"
+#include "../memory.h"
+#include "../paging/paging.h"
+
+static struct shared_memory* shared_memories[MAX_SHARED_MEMORY_COUNT] = {};
+
+// Number of segments each slot has held. It's part of the IDs, so a slot can be reused without old IDs reaching the
+// new segment.
+static uint32_t slot_generations[MAX_SHARED_MEMORY_COUNT] = {};
+
+static struct shared_memory*
+get_shared_memory(int id)
+{
+    if (id < 0) {
+        return 0;
+    }
+
+    struct shared_memory* shm = shared_memories[id % MAX_SHARED_MEMORY_COUNT];
+    if (!shm || shm->id != id || shm->destroyed) {
+        return 0;
+    }
+    return shm;
+}
+
+static struct shared_memory*
+find_shared_memory_by_name(const char* name)
+{
+    for (int i = 0; i < MAX_SHARED_MEMORY_COUNT; i++) {
+        struct shared_memory* shm = shared_memories[i];
+        if (shm && !shm->destroyed && strncmp(shm->name, name, MAX_SHARED_MEMORY_NAME_LENGTH) == 0) {
+            return shared_memories[i];
+        }
+    }
+    return 0;
+}
+
+static int
+find_empty_shared_memory_slot()
+{
+    for (int i = 0; i < MAX_SHARED_MEMORY_COUNT; i++) {
+        if (!shared_memories[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void
+free_shared_memory(struct shared_memory* shm)
+{
+    int slot = shm->id % MAX_SHARED_MEMORY_COUNT;
+    shared_memories[slot] = 0;
+    // IDs must stay positive
+    slot_generations[slot] = (slot_generations[slot] + 1) % (INT32_MAX / MAX_SHARED_MEMORY_COUNT);
+
+    kfree(shm->physical_address);
+    kfree(shm);
+}
+
+/// @brief Creates a named shared memory segment, or returns the existing one with the same name. The segment stays
+/// alive until it's destroyed, or until the process that created it exits.
+/// @param process The process creating (or opening) the segment
+/// @param name The name of the segment. Processes use the same name to find the same segment.
+/// @param size The size of the segment in bytes. It's rounded up to the page size.
+/// @return The shared memory ID (>= 0), or a negative status code.
+int
+shared_memory_create(struct process* process, const char* name, size_t size)
+{
+    if (!name || strlen(name) == 0 || size == 0) {
+        return (int)ERROR(EINVARG);
+    }
+
+    struct shared_memory* shm = find_shared_memory_by_name(name);
+    if (shm) {
+        // The caller is opening an existing segment. It can't ask for more memory than the creator did.
+        if (size > shm->size) {
+            return (int)ERROR(EINVARG);
+        }
+        return shm->id;
+    }
+
+    int slot = find_empty_shared_memory_slot();
+    if (slot < 0) {
+        return (int)ERROR(ETOOMANYSHMS);
+    }
+
+    shm = kzalloc(sizeof(struct shared_memory));
+    if (!shm) {
+        return (int)ERROR(ENOMEM);
+    }
+
+    // The heap hands out page-aligned blocks, so the frames can be mapped page by page into every process.
+    size_t aligned_size = (size + PAGING_PAGE_SIZE_BYTES - 1) / PAGING_PAGE_SIZE_BYTES * PAGING_PAGE_SIZE_BYTES;
+    shm->physical_address = kzalloc(aligned_size);
+    if (!shm->physical_address) {
+        kfree(shm);
+        return (int)ERROR(ENOMEM);
+    }
+
+    shm->id = (int)(slot_generations[slot] * MAX_SHARED_MEMORY_COUNT + slot);
+    strncpy(shm->name, name, sizeof(shm->name) - 1);
+    shm->size = aligned_size;
+    shm->ref_count = 0;
+    shm->creator = process;
+    shm->destroyed = false;
+    shared_memories[slot] = shm;
+
+    return shm->id;
+}
+
+/// @brief Maps the shared memory segment into the process' address space.
+/// @param process The process to attach the segment to.
+/// @param id The shared memory ID returned by `shared_memory_create()`.
+/// @return The address of the segment in the process' address space, or 0 on error.
+void*
+shared_memory_attach(struct process* process, int id)
+{
+    struct shared_memory* shm = get_shared_memory(id);
+    if (!process || !shm) {
+        return 0;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < MAX_SHARED_MEMORY_PER_PROCESS; i++) {
+        if (process->shared_memory[i] == shm) {
+            // already attached
+            return shm->physical_address;
+        }
+        if (slot < 0 && !process->shared_memory[i]) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        return 0;
+    }
+
+    // Same as `process_malloc()`, the virtual address is the physical address. Every attached process sees the segment
+    // at the same address, so pointers into the segment can be shared between processes.
+    // TODO: if the system has more than one task per process, we need to map the address to each task.
+    status_t result = map_paging_addresses(
+      process->task->user_page,
+      shm->physical_address,
+      shm->physical_address,
+      shm->size,
+      PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | PAGING_IS_WRITABLE
+    );
+    if (result != ALL_OK) {
+        return 0;
+    }
+
+    process->shared_memory[slot] = shm;
+    shm->ref_count++;
+
+    return shm->physical_address;
+}
+
+static void
+detach_shared_memory_at(struct process* process, int slot)
+{
+    struct shared_memory* shm = process->shared_memory[slot];
+    process->shared_memory[slot] = 0;
+
+    if (process->task && process->task->user_page) {
+        map_paging_addresses(process->task->user_page, shm->physical_address, shm->physical_address, shm->size, 0);
+    }
+
+    shm->ref_count--;
+    if (shm->ref_count == 0 && shm->destroyed) {
+        free_shared_memory(shm);
+    }
+}
+
+/// @brief Unmaps the shared memory segment at `address` from the process' address space.
+/// @param process The process to detach the segment from.
+/// @param address The address returned by `shared_memory_attach()`.
+/// @return ALL_OK if the segment is detached.
+status_t
+shared_memory_detach(struct process* process, void* address)
+{
+    if (!process || !address) {
+        return ERROR(EINVARG);
+    }
+
+    for (int i = 0; i < MAX_SHARED_MEMORY_PER_PROCESS; i++) {
+        if (process->shared_memory[i] && process->shared_memory[i]->physical_address == address) {
+            detach_shared_memory_at(process, i);
+            return ALL_OK;
+        }
+    }
+
+    // `address` is not a shared memory segment attached to this process
+    return ERROR(EINVARG);
+}
+
+// Makes the segment unreachable by name and ID. Processes that have it attached keep it until they detach it.
+static void
+destroy_shared_memory(struct shared_memory* shm)
+{
+    shm->destroyed = true;
+    shm->creator = 0;
+    if (shm->ref_count == 0) {
+        free_shared_memory(shm);
+    }
+}
+
+/// @brief Destroys the shared memory segment. Its name and ID can't be used to attach it anymore, and its memory is
+/// freed once every process that has it attached detaches it. Only the process that created the segment can destroy it.
+/// @param process The process destroying the segment.
+/// @param id The shared memory ID returned by `shared_memory_create()`.
+/// @return ALL_OK, or EINVARG if there is no such segment or the process didn't create it.
+status_t
+shared_memory_destroy(struct process* process, int id)
+{
+    struct shared_memory* shm = get_shared_memory(id);
+    if (!process || !shm || shm->creator != process) {
+        return ERROR(EINVARG);
+    }
+
+    destroy_shared_memory(shm);
+    return ALL_OK;
+}
+
+/// @brief Detaches all shared memory segments from the process, and destroys the segments it created. This is called
+/// when the process exits. A segment must not outlive its creator, because nothing else could destroy it.
+/// @param process The process to detach the segments from.
+void
+shared_memory_detach_all(struct process* process)
+{
+    if (!process) {
+        return;
+    }
+
+    for (int i = 0; i < MAX_SHARED_MEMORY_PER_PROCESS; i++) {
+        if (process->shared_memory[i]) {
+            detach_shared_memory_at(process, i);
+        }
+    }
+
+    for (int i = 0; i < MAX_SHARED_MEMORY_COUNT; i++) {
+        if (shared_memories[i] && shared_memories[i]->creator == process) {
+            destroy_shared_memory(shared_memories[i]);
+        }
+    }
+}
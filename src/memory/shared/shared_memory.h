@@ -0,0 +1,42 @@
+#ifndef SHARED_MEMORY_H
+#define SHARED_MEMORY_H
+
+#include "../../config.h"
+#include "../../status.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// forward declaration
+struct process;
+
+// A named block of physical memory that can be mapped into the address space of more than one process.
+struct shared_memory
+{
+    // Shared memory ID. This is the handle user programs pass to `shm_attach()`. The slot in the segment table is
+    // `id % MAX_SHARED_MEMORY_COUNT`, and the rest counts the segments the slot has held, so an old ID never names a
+    // new segment.
+    int id;
+    char name[MAX_SHARED_MEMORY_NAME_LENGTH];
+
+    // Page-aligned physical frames backing the segment. The same frames are mapped into every attached process.
+    void* physical_address;
+    size_t size;
+
+    // Number of processes that currently have this segment attached
+    uint32_t ref_count;
+
+    // The segment lives until its creator destroys it with `shared_memory_destroy()` or exits, even while no process
+    // has it attached. A destroyed segment can't be found by name or ID anymore, and is freed when the last process
+    // detaches it.
+    struct process* creator;
+    bool destroyed;
+};
+
+int shared_memory_create(struct process* process, const char* name, size_t size);
+void* shared_memory_attach(struct process* process, int id);
+status_t shared_memory_detach(struct process* process, void* address);
+status_t shared_memory_destroy(struct process* process, int id);
+void shared_memory_detach_all(struct process* process);
+
+#endif
@@ -0,0 +1,112 @@
+#include "pci.h"
+#include "../io/io.h"
+#include "../memory/memory.h"
+#include <stdbool.h>
+
+// Configuration Space Access Mechanism #1
+// https://wiki.osdev.org/PCI#Configuration_Space_Access_Mechanism_.231
+#define PCI_CONFIG_ADDRESS_PORT 0xCF8
+#define PCI_CONFIG_DATA_PORT    0xCFC
+#define PCI_CONFIG_ENABLE       0x80000000
+
+#define PCI_MAX_BUSES            256
+#define PCI_MAX_SLOTS            32
+#define PCI_MAX_FUNCTIONS        8
+#define PCI_VENDOR_NONE          0xFFFF // no device in this slot
+#define PCI_HEADER_MULTIFUNCTION 0x80
+
+static uint32_t
+pci_config_address(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    // The offset must be aligned to 4 bytes. We always read the whole double word and let the caller pick the field.
+    return PCI_CONFIG_ENABLE | ((uint32_t)bus << 16) | ((uint32_t)(slot & 0x1F) << 11) |
+           ((uint32_t)(function & 0x07) << 8) | (offset & 0xFC);
+}
+
+static uint32_t
+pci_config_read_raw(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    outl(PCI_CONFIG_ADDRESS_PORT, pci_config_address(bus, slot, function, offset));
+    return inl(PCI_CONFIG_DATA_PORT);
+}
+
+uint32_t
+pci_config_read(struct pci_device* device, uint8_t offset)
+{
+    return pci_config_read_raw(device->bus, device->slot, device->function, offset);
+}
+
+void
+pci_config_write(struct pci_device* device, uint8_t offset, uint32_t value)
+{
+    outl(PCI_CONFIG_ADDRESS_PORT, pci_config_address(device->bus, device->slot, device->function, offset));
+    outl(PCI_CONFIG_DATA_PORT, value);
+}
+
+static bool
+pci_check_function(
+  uint8_t bus,
+  uint8_t slot,
+  uint8_t function,
+  uint8_t class_code,
+  uint8_t subclass,
+  struct pci_device* out_device
+)
+{
+    uint32_t id = pci_config_read_raw(bus, slot, function, PCI_CONFIG_VENDOR_ID);
+    if ((id & 0xFFFF) == PCI_VENDOR_NONE) {
+        return false;
+    }
+
+    uint32_t class = pci_config_read_raw(bus, slot, function, PCI_CONFIG_CLASS);
+    if (((class >> 24) & 0xFF) != class_code || ((class >> 16) & 0xFF) != subclass) {
+        return false;
+    }
+
+    out_device->bus = bus;
+    out_device->slot = slot;
+    out_device->function = function;
+    out_device->vendor_id = id & 0xFFFF;
+    out_device->device_id = id >> 16;
+    out_device->class_code = class_code;
+    out_device->subclass = subclass;
+    out_device->prog_if = (class >> 8) & 0xFF;
+    return true;
+}
+
+/// @brief Scans the PCI buses for the first device with the given class and subclass.
+/// @param class_code The PCI class code, i.e., PCI_CLASS_MASS_STORAGE
+/// @param subclass The PCI subclass, i.e., PCI_SUBCLASS_IDE
+/// @param out_device The device found
+/// @return ALL_OK if the device is found.
+status_t
+pci_find_device(uint8_t class_code, uint8_t subclass, struct pci_device* out_device)
+{
+    if (!out_device) {
+        return ERROR(EINVARG);
+    }
+
+    memset(out_device, 0, sizeof(struct pci_device));
+
+    // Brute-force scan. This is only done once at boot, so we don't bother with the recursive bridge scan.
+    for (int bus = 0; bus < PCI_MAX_BUSES; bus++) {
+        for (int slot = 0; slot < PCI_MAX_SLOTS; slot++) {
+            if ((pci_config_read_raw(bus, slot, 0, PCI_CONFIG_VENDOR_ID) & 0xFFFF) == PCI_VENDOR_NONE) {
+                continue;
+            }
+
+            int functions = 1;
+            if ((pci_config_read_raw(bus, slot, 0, PCI_CONFIG_HEADER) >> 16) & PCI_HEADER_MULTIFUNCTION) {
+                functions = PCI_MAX_FUNCTIONS;
+            }
+
+            for (int function = 0; function < functions; function++) {
+                if (pci_check_function(bus, slot, function, class_code, subclass, out_device)) {
+                    return ALL_OK;
+                }
+            }
+        }
+    }
+
+    return ERROR(EIO);
+}
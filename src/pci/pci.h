@@ -0,0 +1,39 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "../status.h"
+#include <stdint.h>
+
+// Offsets in the PCI configuration space header (type 0x00)
+// https://wiki.osdev.org/PCI#Configuration_Space
+#define PCI_CONFIG_VENDOR_ID 0x00
+#define PCI_CONFIG_COMMAND   0x04
+#define PCI_CONFIG_CLASS     0x08 // revision ID, prog IF, subclass, class code
+#define PCI_CONFIG_HEADER    0x0C // cache line size, latency timer, header type, BIST
+#define PCI_CONFIG_BAR4      0x20
+
+#define PCI_COMMAND_IO_SPACE   0x0001
+#define PCI_COMMAND_BUS_MASTER 0x0004
+
+#define PCI_CLASS_MASS_STORAGE    0x01
+#define PCI_SUBCLASS_IDE          0x01
+#define PCI_PROG_IF_BUS_MASTERING 0x80 // the IDE controller supports bus-master DMA
+
+struct pci_device
+{
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+};
+
+uint32_t pci_config_read(struct pci_device* device, uint8_t offset);
+void pci_config_write(struct pci_device* device, uint8_t offset, uint32_t value);
+status_t pci_find_device(uint8_t class_code, uint8_t subclass, struct pci_device* out_device);
+
+#endif
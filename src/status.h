@@ -17,6 +17,10 @@ typedef void* status_t;
 #define EFILENOTSUPPORTED   11
 #define ETOOMANYPROCMALLOCS 12
 #define ETOOMANYARGS        13
+#define ETOOMANYSHMS        14
+#define ENOSPACE            15
+#define ENOMOREENTRIES      16
+#define EBUSY               17
 
 #define ERROR(v) ((void*)(-v))
 
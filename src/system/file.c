@@ -0,0 +1,287 @@
+#include "file.h"
+#include "../config.h"
+#include "../disk/disk.h"
+#include "../fs/file.h"
+#include "../memory/paging/paging.h"
+#include "../string/string.h"
+#include "../task/process.h"
+#include "../task/task.h"
+#include "syscall.h"
+
+// Number of pieces of user buffers `sys_preadv()` reads with one `fpreadv()`
+#define PREADV_BATCH_SIZE 32
+
+// int sync();
+void*
+sys_sync(struct interrupt_frame* frame)
+{
+    return (void*)disk_flush_all();
+}
+
+// int fsync(int fd);
+void*
+sys_fsync(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int fd = (int)get_arg_from_task(current_task, 0);
+    return (void*)fsync(file_table_get(&current_task->process->files, fd));
+}
+
+// Gives the process a descriptor for an open file or directory. It's closed if the process has no free descriptor.
+static int
+add_to_process_files(struct process* process, int fd, bool directory)
+{
+    int process_fd = file_table_add(&process->files, fd);
+    if (!process_fd) {
+        if (directory) {
+            closedir(fd);
+        } else {
+            fclose(fd);
+        }
+    }
+    return process_fd;
+}
+
+// int open(const char* path, const char* mode);
+void*
+sys_open(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    char* path_arg = (char*)get_arg_from_task(current_task, 0);
+    char* mode_arg = (char*)get_arg_from_task(current_task, 1);
+
+    char path[MAX_PATH_LENGTH];
+    status_t result = copy_data_from_user_space(current_task, path_arg, path, sizeof(path));
+    if (result != ALL_OK) {
+        return result;
+    }
+    path[sizeof(path) - 1] = '\0';
+
+    // Only "r" is allowed. One more character is copied so that longer modes stay invalid.
+    char mode[3];
+    result = copy_data_from_user_space(current_task, mode_arg, mode, sizeof(mode));
+    if (result != ALL_OK) {
+        return result;
+    }
+    mode[sizeof(mode) - 1] = '\0';
+
+    // There is no write syscall yet, so "w" would only let a program cut any file to 0 bytes, and "a" is useless
+    if (strncmp(mode, "r", sizeof(mode)) != 0) {
+        return 0;
+    }
+
+    int fd = fopen(path, mode);
+    if (!fd) {
+        return 0;
+    }
+    return (void*)add_to_process_files(current_task->process, fd, false);
+}
+
+// int read(int fd, void* buffer, size_t size);
+void*
+sys_read(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int fd = file_table_get(&current_task->process->files, (int)get_arg_from_task(current_task, 0));
+    void* buffer = get_arg_from_task(current_task, 1);
+    size_t size = (size_t)get_arg_from_task(current_task, 2);
+
+    if (!fd) {
+        return ERROR(EINVARG);
+    }
+
+    // The file is read straight into the user buffer, a page at a time, because the pages of the buffer can be
+    // anywhere in the physical memory
+    size_t total = 0;
+    while (total < size) {
+        void* chunk = 0;
+        size_t chunk_size = 0;
+        status_t result = get_user_space_physical_address(current_task, buffer + total, true, &chunk, &chunk_size);
+        if (result != ALL_OK) {
+            return total > 0 ? (void*)total : result;
+        }
+        if (chunk_size > size - total) {
+            chunk_size = size - total;
+        }
+
+        size_t read = fread(chunk, 1, chunk_size, fd);
+        total += read;
+        if (read < chunk_size) {
+            // end of the file
+            break;
+        }
+    }
+    return (void*)total;
+}
+
+// The pieces of user buffers `sys_preadv()` reads with one `fpreadv()`
+struct preadv_batch
+{
+    struct file_io_vector vectors[PREADV_BATCH_SIZE];
+    uint32_t count;
+    size_t size;
+};
+
+// Reads the batch after the `total` bytes already read from `offset`, and empties it. Returns false at the end of the
+// file.
+static bool
+read_preadv_batch(int fd, struct preadv_batch* batch, uint32_t offset, size_t* total)
+{
+    size_t read = fpreadv(fd, batch->vectors, batch->count, offset + *total);
+    *total += read;
+
+    bool filled = read == batch->size;
+    batch->count = 0;
+    batch->size = 0;
+    return filled;
+}
+
+// int preadv(int fd, const struct iovec* vectors, int count, unsigned int offset);
+void*
+sys_preadv(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int fd = file_table_get(&current_task->process->files, (int)get_arg_from_task(current_task, 0));
+    struct file_io_vector* vectors = get_arg_from_task(current_task, 1);
+    int count = (int)get_arg_from_task(current_task, 2);
+    uint32_t offset = (uint32_t)get_arg_from_task(current_task, 3);
+
+    if (!fd || count < 0) {
+        return ERROR(EINVARG);
+    }
+
+    // Like `sys_read()`, the file is read straight into the user buffers. Each buffer is split at its page boundaries,
+    // and the pieces of all the buffers go to `fpreadv()` a batch at a time.
+    struct preadv_batch batch;
+    batch.count = 0;
+    batch.size = 0;
+    size_t total = 0;
+    status_t result = ALL_OK;
+    bool end_of_file = false;
+
+    for (int i = 0; i < count && result == ALL_OK && !end_of_file; i++) {
+        struct file_io_vector vector;
+        result = copy_data_from_user_space(current_task, &vectors[i], &vector, sizeof(vector));
+
+        size_t done = 0;
+        while (result == ALL_OK && !end_of_file && done < vector.size) {
+            void* chunk = 0;
+            size_t chunk_size = 0;
+            result = get_user_space_physical_address(current_task, vector.buffer + done, true, &chunk, &chunk_size);
+            if (result != ALL_OK) {
+                break;
+            }
+            if (chunk_size > vector.size - done) {
+                chunk_size = vector.size - done;
+            }
+
+            batch.vectors[batch.count].buffer = chunk;
+            batch.vectors[batch.count].size = chunk_size;
+            batch.count++;
+            batch.size += chunk_size;
+            done += chunk_size;
+
+            if (batch.count == PREADV_BATCH_SIZE) {
+                end_of_file = !read_preadv_batch(fd, &batch, offset, &total);
+            }
+        }
+    }
+
+    // The buffers before a bad one are still read
+    if (!end_of_file && batch.count > 0) {
+        read_preadv_batch(fd, &batch, offset, &total);
+    }
+    if (result != ALL_OK && total == 0) {
+        return result;
+    }
+    return (void*)total;
+}
+
+// int lseek(int fd, unsigned int offset, int whence);
+void*
+sys_lseek(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int fd = (int)get_arg_from_task(current_task, 0);
+    uint32_t offset = (uint32_t)get_arg_from_task(current_task, 1);
+    FILE_SEEK_MODE mode = (FILE_SEEK_MODE)get_arg_from_task(current_task, 2);
+    return fseek(file_table_get(&current_task->process->files, fd), offset, mode);
+}
+
+// int fstat(int fd, struct stat* stat);
+void*
+sys_fstat(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int fd = (int)get_arg_from_task(current_task, 0);
+    void* stat_arg = get_arg_from_task(current_task, 1);
+
+    struct file_stat stat;
+    status_t result = fstat(file_table_get(&current_task->process->files, fd), &stat);
+    if (result != ALL_OK) {
+        return result;
+    }
+    return copy_data_to_user_space(current_task, &stat, stat_arg, sizeof(stat));
+}
+
+// int close(int fd);
+void*
+sys_close(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int fd = (int)get_arg_from_task(current_task, 0);
+    return file_table_close(&current_task->process->files, fd);
+}
+
+// int opendir(const char* path);
+void*
+sys_opendir(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    char* arg = (char*)get_arg_from_task(current_task, 0);
+
+    char path[MAX_PATH_LENGTH];
+    status_t result = copy_data_from_user_space(current_task, arg, path, sizeof(path));
+    if (result != ALL_OK) {
+        return result;
+    }
+    path[sizeof(path) - 1] = '\0';
+
+    int fd = opendir(path);
+    if (!fd) {
+        return 0;
+    }
+    return (void*)add_to_process_files(current_task->process, fd, true);
+}
+
+// int readdir(int fd, struct dirent* entry);
+void*
+sys_readdir(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int fd = (int)get_arg_from_task(current_task, 0);
+    void* entry = get_arg_from_task(current_task, 1);
+
+    struct file_dirent dirent;
+    status_t result = readdir(file_table_get(&current_task->process->files, fd), &dirent);
+    if (result != ALL_OK) {
+        return result;
+    }
+    return copy_data_to_user_space(current_task, &dirent, entry, sizeof(dirent));
+}
+
+// int closedir(int fd);
+void*
+sys_closedir(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int fd = (int)get_arg_from_task(current_task, 0);
+
+    // `closedir()` refuses file descriptors, so the descriptor is only dropped if it's a directory
+    struct file_table* files = &current_task->process->files;
+    status_t result = closedir(file_table_get(files, fd));
+    if (result == ALL_OK) {
+        file_table_remove(files, fd);
+    }
+    return result;
+}
@@ -0,0 +1,18 @@
+#ifndef SYSCALL_FILE_H
+#define SYSCALL_FILE_H
+
+#include "../idt/idt.h"
+
+void* sys_sync(struct interrupt_frame* frame);
+void* sys_fsync(struct interrupt_frame* frame);
+void* sys_open(struct interrupt_frame* frame);
+void* sys_read(struct interrupt_frame* frame);
+void* sys_preadv(struct interrupt_frame* frame);
+void* sys_lseek(struct interrupt_frame* frame);
+void* sys_fstat(struct interrupt_frame* frame);
+void* sys_close(struct interrupt_frame* frame);
+void* sys_opendir(struct interrupt_frame* frame);
+void* sys_readdir(struct interrupt_frame* frame);
+void* sys_closedir(struct interrupt_frame* frame);
+
+#endif
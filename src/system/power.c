@@ -0,0 +1,10 @@
+#include "power.h"
+#include "sys.h"
+
+// void shutdown();
+void*
+sys_shutdown(struct interrupt_frame* frame)
+{
+    shutdown();
+    return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef SYSCALL_POWER_H
+#define SYSCALL_POWER_H
+
+#include "../idt/idt.h"
+
+void* sys_shutdown(struct interrupt_frame* frame);
+
+#endif
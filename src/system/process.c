@@ -94,11 +94,9 @@ sys_exit(struct interrupt_frame* frame)
     struct task* task = get_current_task();
     int status = (int)get_arg_from_task(task, 0);
 
-    // Disable interrupts while we terminate the process. Otherwise, the scheduler may switch to another task and come
-    // back to this task later. At that time, some of the memory pages of this process may have been freed.
-    disable_interrupts();
+    // Syscalls run with interrupts disabled, so the scheduler can't switch to another task and come back to this one
+    // while its memory is being freed. Freeing the task also releases the kernel lock.
     terminate_process(task->process, status);
-    enable_interrupts();
 
     // Send ack. Since we've already freed the process so there's nothing to return to, so call switch_task() to switch
     // to another process' task.
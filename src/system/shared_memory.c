@@ -0,0 +1,52 @@
+#include "shared_memory.h"
+#include "../config.h"
+#include "../memory/paging/paging.h"
+#include "../memory/shared/shared_memory.h"
+#include "../task/process.h"
+#include "../task/task.h"
+#include "syscall.h"
+
+// int shm_create(const char* name, size_t size);
+void*
+sys_shm_create(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    char* arg = (char*)get_arg_from_task(current_task, 0);
+    size_t size = (size_t)get_arg_from_task(current_task, 1);
+
+    char name[MAX_SHARED_MEMORY_NAME_LENGTH];
+    status_t result = copy_data_from_user_space(current_task, arg, name, sizeof(name));
+    if (result != ALL_OK) {
+        return result;
+    }
+    name[sizeof(name) - 1] = '\0';
+
+    return (void*)shared_memory_create(current_task->process, name, size);
+}
+
+// void* shm_attach(int id);
+void*
+sys_shm_attach(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int id = (int)get_arg_from_task(current_task, 0);
+    return shared_memory_attach(current_task->process, id);
+}
+
+// int shm_detach(void* ptr);
+void*
+sys_shm_detach(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    void* ptr = get_arg_from_task(current_task, 0);
+    return shared_memory_detach(current_task->process, ptr);
+}
+
+// int shm_destroy(int id);
+void*
+sys_shm_destroy(struct interrupt_frame* frame)
+{
+    struct task* current_task = get_current_task();
+    int id = (int)get_arg_from_task(current_task, 0);
+    return shared_memory_destroy(current_task->process, id);
+}
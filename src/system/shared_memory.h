@@ -0,0 +1,11 @@
+#ifndef SYSCALL_SHARED_MEMORY_H
+#define SYSCALL_SHARED_MEMORY_H
+
+#include "../idt/idt.h"
+
+void* sys_shm_create(struct interrupt_frame* frame);
+void* sys_shm_attach(struct interrupt_frame* frame);
+void* sys_shm_detach(struct interrupt_frame* frame);
+void* sys_shm_destroy(struct interrupt_frame* frame);
+
+#endif
@@ -1,6 +1,13 @@
 #include "sys.h"
+#include "../disk/disk.h"
+#include "../io/io.h"
 #include "../terminal/terminal.h"
 
+// ACPI shutdown ports of the emulators we run on. Real hardware needs the port and value from the ACPI tables.
+#define QEMU_SHUTDOWN_PORT  0x604
+#define BOCHS_SHUTDOWN_PORT 0xB004
+#define ACPI_SHUTDOWN_VALUE 0x2000
+
 void
 panic(const char* message)
 {
@@ -9,3 +16,19 @@ panic(const char* message)
     print("\n");
     while (1) {};
 }
+
+/// @brief Writes all cached disk data back and powers the machine off.
+void
+shutdown()
+{
+    if (disk_flush_all() != ALL_OK) {
+        print("WARNING: failed to flush the disks\n");
+    }
+
+    outw(QEMU_SHUTDOWN_PORT, ACPI_SHUTDOWN_VALUE);
+    outw(BOCHS_SHUTDOWN_PORT, ACPI_SHUTDOWN_VALUE);
+
+    // The machine didn't power off. At least, the disks are safe now.
+    print("It's now safe to turn off your computer.\n");
+    while (1) {};
+}
@@ -2,5 +2,6 @@
 #define SYS_H
 
 void panic(const char* message);
+void shutdown();
 
 #endif
@@ -1,9 +1,12 @@
 #include "syscall.h"
 #include "../config.h"
 #include "../memory/paging/paging.h"
+#include "./file.h"
 #include "./heap.h"
 #include "./io.h"
+#include "./power.h"
 #include "./process.h"
+#include "./shared_memory.h"
 #include "./sys.h"
 
 // TODO: This file should be merged together with other ISR definitions in idt.c and placed in isr.c or something.
@@ -52,6 +55,22 @@ initialize_syscall_handlers()
     register_syscall_handler(SYSCALL_COMMAND_PUTS, sys_puts);
     register_syscall_handler(SYSCALL_COMMAND_MALLOC, sys_malloc);
     register_syscall_handler(SYSCALL_COMMAND_FREE, sys_free);
+    register_syscall_handler(SYSCALL_COMMAND_SHM_CREATE, sys_shm_create);
+    register_syscall_handler(SYSCALL_COMMAND_SHM_ATTACH, sys_shm_attach);
+    register_syscall_handler(SYSCALL_COMMAND_SHM_DETACH, sys_shm_detach);
+    register_syscall_handler(SYSCALL_COMMAND_SYNC, sys_sync);
+    register_syscall_handler(SYSCALL_COMMAND_FSYNC, sys_fsync);
+    register_syscall_handler(SYSCALL_COMMAND_SHUTDOWN, sys_shutdown);
+    register_syscall_handler(SYSCALL_COMMAND_OPENDIR, sys_opendir);
+    register_syscall_handler(SYSCALL_COMMAND_READDIR, sys_readdir);
+    register_syscall_handler(SYSCALL_COMMAND_CLOSEDIR, sys_closedir);
+    register_syscall_handler(SYSCALL_COMMAND_OPEN, sys_open);
+    register_syscall_handler(SYSCALL_COMMAND_READ, sys_read);
+    register_syscall_handler(SYSCALL_COMMAND_LSEEK, sys_lseek);
+    register_syscall_handler(SYSCALL_COMMAND_FSTAT, sys_fstat);
+    register_syscall_handler(SYSCALL_COMMAND_CLOSE, sys_close);
+    register_syscall_handler(SYSCALL_COMMAND_SHM_DESTROY, sys_shm_destroy);
+    register_syscall_handler(SYSCALL_COMMAND_PREADV, sys_preadv);
 }
 
 void*
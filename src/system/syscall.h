@@ -14,6 +14,22 @@ enum SYSCALL_COMMAND
     SYSCALL_COMMAND_PUTS = 4,
     SYSCALL_COMMAND_MALLOC = 5,
     SYSCALL_COMMAND_FREE = 6,
+    SYSCALL_COMMAND_SHM_CREATE = 7,
+    SYSCALL_COMMAND_SHM_ATTACH = 8,
+    SYSCALL_COMMAND_SHM_DETACH = 9,
+    SYSCALL_COMMAND_SYNC = 10,
+    SYSCALL_COMMAND_FSYNC = 11,
+    SYSCALL_COMMAND_SHUTDOWN = 12,
+    SYSCALL_COMMAND_OPENDIR = 13,
+    SYSCALL_COMMAND_READDIR = 14,
+    SYSCALL_COMMAND_CLOSEDIR = 15,
+    SYSCALL_COMMAND_OPEN = 16,
+    SYSCALL_COMMAND_READ = 17,
+    SYSCALL_COMMAND_LSEEK = 18,
+    SYSCALL_COMMAND_FSTAT = 19,
+    SYSCALL_COMMAND_CLOSE = 20,
+    SYSCALL_COMMAND_SHM_DESTROY = 21,
+    SYSCALL_COMMAND_PREADV = 22,
 };
 
 void initialize_syscall_handlers();
@@ -5,6 +5,7 @@
 #include "../memory/heap/kheap.h"
 #include "../memory/memory.h"
 #include "../memory/paging/paging.h"
+#include "../memory/shared/shared_memory.h"
 #include "../string/string.h"
 #include "../system/sys.h"
 #include "task.h"
@@ -122,6 +123,11 @@ free_process(struct process* process)
         }
     }
 
+    file_table_close_all(&process->files);
+
+    // This must be done before freeing the task, because detaching unmaps the segments from the task's paging map.
+    shared_memory_detach_all(process);
+
     if (process->task) {
         free_task(process->task);
     }
@@ -2,7 +2,9 @@
 #define PROCESS_H
 
 #include "../config.h"
+#include "../fs/file.h"
 #include "../keyboard/keyboard.h"
+#include "../memory/shared/shared_memory.h"
 #include "../status.h"
 #include <stddef.h>
 #include <stdint.h>
@@ -62,6 +64,12 @@ struct process
     // TODO: This should be a pointer and malloced in the heap when we create a process.
     struct allocation* allocations[MAX_ALLOCATIONS_PER_PROCESS];
 
+    // Shared memory segments attached to this process. They are detached when the process exits.
+    struct shared_memory* shared_memory[MAX_SHARED_MEMORY_PER_PROCESS];
+
+    // Files and directories opened by this process. They are closed when the process exits.
+    struct file_table files;
+
     // The program file that this process is running.
     struct program* program;
 
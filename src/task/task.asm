@@ -3,6 +3,7 @@
 section .asm
 
 global jump_to_user_space
+global switch_kernel_context
 
 ; void jump_to_user_space(struct registers* registers);
 jump_to_user_space:
@@ -53,3 +54,23 @@ restore_general_purpose_registers:
 
     ; Do not call `mov esp, ebp` because we changed the value of ebp
     ret
+
+; void switch_kernel_context(uint32_t* save_esp, uint32_t esp);
+; Saves the callee-saved registers on the current stack and the stack pointer in `save_esp`, then continues the
+; context saved at `esp`. The call returns when something switches back to the saved context.
+switch_kernel_context:
+    mov eax, [esp + 4]      ; `save_esp`
+    mov ecx, [esp + 8]      ; `esp`
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp
+
+    mov esp, ecx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
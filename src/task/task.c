@@ -6,12 +6,28 @@
 #include "../memory/paging/paging.h"
 #include "../status.h"
 #include "../system/sys.h"
+#include "tss.h"
 
 struct task* current_task = 0;
 struct task* head_task = 0;
 struct task* tail_task = 0;
 
+// False until the first task runs. Before that, the kernel runs on its boot stack and there is nothing to switch to.
+static bool tasks_started = false;
+
+// The kernel stack of a task that exited. We may still be running on it, so it's freed once we've switched away.
+static void* dead_kernel_stack = 0;
+
+// The last task an interrupt woke up (see `task_run_woken()`)
+static struct task* woken_task = 0;
+
+// The task in a syscall (see `kernel_lock_acquire()`)
+static struct task* kernel_lock_owner = 0;
+
+extern struct tss tss;
+
 extern void jump_to_user_space(struct registers* registers);
+extern void switch_kernel_context(uint32_t* save_esp, uint32_t esp);
 
 static status_t
 initialize_task(struct task* task, struct process* process)
@@ -25,6 +41,11 @@ initialize_task(struct task* task, struct process* process)
         return ERROR(EIO);
     }
 
+    task->kernel_stack = kzalloc(TASK_KERNEL_STACK_SIZE);
+    if (!task->kernel_stack) {
+        return ERROR(ENOMEM);
+    }
+
     task->registers.eip = (uint32_t)process->program->entry_point_address;
     task->registers.esp = USER_PROGRAM_STACK_VIRTUAL_ADDRESS_START;
     task->registers.ss = USER_PROGRAM_DATA_SELECTOR;
@@ -52,6 +73,16 @@ get_next_task()
     return current_task->next;
 }
 
+// True if the CPU is running on the kernel stack of the task
+static bool
+is_running_on_stack(struct task* task)
+{
+    char here;
+    uint32_t address = (uint32_t)&here;
+    uint32_t bottom = (uint32_t)task->kernel_stack;
+    return task->kernel_stack && address >= bottom && address < bottom + TASK_KERNEL_STACK_SIZE;
+}
+
 static status_t
 remove_task_from_queue(struct task* task)
 {
@@ -131,6 +162,23 @@ free_task(struct task* task)
         free_paging_map(task->user_page);
     }
 
+    if (kernel_lock_owner == task) {
+        kernel_lock_release();
+    }
+    if (woken_task == task) {
+        woken_task = 0;
+    }
+
+    if (is_running_on_stack(task)) {
+        // The task is exiting. Its stack is freed after the switch to the next task.
+        if (dead_kernel_stack) {
+            kfree(dead_kernel_stack);
+        }
+        dead_kernel_stack = task->kernel_stack;
+    } else if (task->kernel_stack) {
+        kfree(task->kernel_stack);
+    }
+
     remove_task_from_queue(task);
     kfree(task);
 
@@ -145,20 +193,190 @@ get_current_task()
     return current_task;
 }
 
+static void
+free_dead_kernel_stack()
+{
+    if (dead_kernel_stack) {
+        kfree(dead_kernel_stack);
+        dead_kernel_stack = 0;
+    }
+}
+
+// Where a task that continues in user space starts on its kernel stack (see `run_task()`)
+static void
+task_enter_user_space()
+{
+    free_dead_kernel_stack();
+    switch_to_user_page(current_task);
+    jump_to_user_space(&current_task->registers);
+}
+
+/// @brief Makes `next` the current task and continues it where it stopped: in the kernel if it was switched away from
+/// there, in user space otherwise. Interrupts must be disabled and the kernel page active.
+/// @param next The task to run
+/// @param save_esp Receives the kernel context we are leaving, so it can be continued later. If it's 0, the context is
+/// dropped (i.e., in an interrupt whose task state has been saved in its registers).
+static void
+run_task(struct task* next, uint32_t* save_esp)
+{
+    uint32_t dropped_esp = 0;
+    if (!save_esp) {
+        save_esp = &dropped_esp;
+    }
+
+    current_task = next;
+    tasks_started = true;
+    if (next->process->state == PROCESS_STATE_READY) {
+        next->process->state = PROCESS_STATE_RUNNING;
+    }
+
+    // The next interrupt or syscall of the task starts at the top of its own kernel stack
+    uint32_t stack_top = (uint32_t)next->kernel_stack + TASK_KERNEL_STACK_SIZE;
+    tss.esp0 = stack_top;
+
+    if (next->kernel_esp) {
+        uint32_t esp = next->kernel_esp;
+        next->kernel_esp = 0;
+        switch_kernel_context(save_esp, esp);
+        // We are back in the task that called `run_task()`
+        free_dead_kernel_stack();
+        return;
+    }
+
+    if (is_running_on_stack(next)) {
+        // This is an interrupt of `next` itself. Its stack only holds the interrupt frame, so we can leave from here.
+        free_dead_kernel_stack();
+        switch_to_user_page(next);
+        jump_to_user_space(&next->registers);
+    }
+
+    // Build the context `switch_kernel_context` pops (EDI, ESI, EBX, EBP, return address) at the top of the unused
+    // stack of `next`, so that it "returns" into `task_enter_user_space()`
+    uint32_t* stack = (uint32_t*)stack_top;
+    *--stack = 0; // return address of `task_enter_user_space()`, which never returns
+    *--stack = (uint32_t)task_enter_user_space;
+    *--stack = 0; // EBP
+    *--stack = 0; // EBX
+    *--stack = 0; // ESI
+    *--stack = 0; // EDI
+    switch_kernel_context(save_esp, (uint32_t)stack);
+    free_dead_kernel_stack();
+}
+
+// Round robin: the first runnable task after the current one, the current task itself last. 0 if every task is blocked.
+static struct task*
+get_next_runnable_task()
+{
+    if (!current_task || !head_task) {
+        panic("No task is running in the system!");
+    }
+
+    struct task* task = current_task;
+    do {
+        task = task->next ? task->next : head_task;
+        if (task->state == TASK_STATE_RUNNABLE) {
+            return task;
+        }
+    } while (task != current_task);
+    return 0;
+}
+
+// Waits until a task is runnable. The interrupts that wake tasks up come in while the CPU halts.
+static struct task*
+wait_for_runnable_task()
+{
+    struct task* next = get_next_runnable_task();
+    while (!next) {
+        wait_for_interrupt();
+        next = get_next_runnable_task();
+    }
+    return next;
+}
+
+/// @brief Switches to the next runnable task. Called from an interrupt once the state of the interrupted task is saved
+/// in its registers (or the task has exited), so the current kernel context is dropped. Doesn't return.
 void
 switch_task()
 {
-    struct task* next_task = get_next_task();
-    if (!next_task) {
-        panic("No task is running in the system!");
+    run_task(wait_for_runnable_task(), 0);
+}
+
+/// @brief Blocks the current task until `task_wake()` is called on it, and runs the other tasks in the meantime. Must
+/// be called with interrupts disabled, in the kernel context of the current task (i.e., in a syscall). Before the first
+/// task runs there is nothing to switch to, so it only halts until the next interrupt. Callers check what they are
+/// waiting for in a loop, because it can return before the task is woken up.
+void
+task_block()
+{
+    struct task* task = current_task;
+    if (!tasks_started || !task) {
+        wait_for_interrupt();
+        return;
     }
 
-    current_task = next_task;
+    task->state = TASK_STATE_BLOCKED;
+    struct task* next = wait_for_runnable_task();
+    if (next != task) {
+        run_task(next, &task->kernel_esp);
+    }
+    // We are the current task again, and we have been woken up
+}
 
-    if (current_task->process->state == PROCESS_STATE_READY) {
-        current_task->process->state = PROCESS_STATE_RUNNING;
+/// @brief Makes a blocked task runnable. Called from interrupt handlers (i.e., when a disk request completes).
+void
+task_wake(struct task* task)
+{
+    if (task->state == TASK_STATE_BLOCKED) {
+        task->state = TASK_STATE_RUNNABLE;
+        woken_task = task;
     }
+}
 
-    switch_to_user_page(current_task);
-    jump_to_user_space(&current_task->registers);
+/// @brief Runs the task the last interrupt woke up, instead of letting it wait for the next clock tick. Called at the
+/// end of an interrupt from user space, once the state of the interrupted task is saved in its registers. Doesn't
+/// return if there is a task to run.
+void
+task_run_woken()
+{
+    struct task* task = woken_task;
+    woken_task = 0;
+    if (!task || task == current_task || task->state != TASK_STATE_RUNNABLE || !task->kernel_esp) {
+        return;
+    }
+
+    switch_to_kernel_page();
+    run_task(task, 0);
+}
+
+/// @brief Takes the kernel lock for the current task, and blocks while another task holds it. Syscalls run with the
+/// lock held: a task can block in the middle of the kernel (i.e., in the file system), which must not be entered by
+/// another task until it's done. The other tasks keep running in user space.
+void
+kernel_lock_acquire()
+{
+    struct task* task = current_task;
+    while (kernel_lock_owner && kernel_lock_owner != task) {
+        task->waiting_for_kernel_lock = true;
+        task_block();
+    }
+    task->waiting_for_kernel_lock = false;
+    kernel_lock_owner = task;
+}
+
+/// @brief Releases the kernel lock, and wakes up the tasks waiting for it. They try again when they run.
+void
+kernel_lock_release()
+{
+    kernel_lock_owner = 0;
+    for (struct task* task = head_task; task; task = task->next) {
+        if (task->waiting_for_kernel_lock) {
+            task_wake(task);
+        }
+    }
+}
+
+bool
+kernel_lock_is_held()
+{
+    return kernel_lock_owner != 0;
 }
@@ -3,6 +3,7 @@
 
 #include "../idt/idt.h"
 #include "process.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 struct registers
@@ -24,6 +25,13 @@ struct registers
     uint32_t ss;
 };
 
+enum TASK_STATE
+{
+    TASK_STATE_RUNNABLE = 0,
+    // Waiting in the kernel (i.e., for a disk request) until `task_wake()`. The scheduler skips it.
+    TASK_STATE_BLOCKED,
+};
+
 struct task
 {
     struct paging_map* user_page;
@@ -31,11 +39,28 @@ struct task
     struct process* process;
     struct task* next;
     struct task* prev;
+
+    enum TASK_STATE state;
+
+    // The interrupts and syscalls of the task run on its own kernel stack, so a task can block in the kernel while
+    // other tasks run.
+    void* kernel_stack;
+    // Stack pointer of the kernel context the task was switched away from (see `switch_kernel_context` in task.asm).
+    // 0 if the task continues in user space.
+    uint32_t kernel_esp;
+
+    bool waiting_for_kernel_lock;
 };
 
 struct task* create_task(struct process* process);
 status_t free_task(struct task* task);
 struct task* get_current_task();
 void switch_task();
+void task_block();
+void task_wake(struct task* task);
+void task_run_woken();
+void kernel_lock_acquire();
+void kernel_lock_release();
+bool kernel_lock_is_held();
 
 #endif